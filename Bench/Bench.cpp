@@ -0,0 +1,381 @@
+#include "Nes.h"
+#include "Pacer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// benchmarks for the machine state. not part of the emulator, run from the command line:
+//
+//   Bench clone [cChildMax]    clone cost and memory as live clones grow to cChildMax (100000)
+//   Bench trap                 cpu throughput with and without a debugger attached.
+//                              build with NO_TRAPS defined for the cpu without trap support
+//   Bench ppu [cStep]          checks an NMI every frame, and that the ppu on its own thread gives
+//                              exactly what it does inline
+
+// an NROM cartridge with 32Kb of prg rom, all zero
+
+Rom* PRomSynthetic()
+{
+	Rom* pRom = new Rom;
+	pRom->cRef = 1;
+	pRom->nMapper = 0;
+	pRom->fVerticalMirroring = false;
+	pRom->cbPrg = 32 * KB;
+	pRom->pbPrg = new byte[pRom->cbPrg];
+	memset(pRom->pbPrg, 0, pRom->cbPrg);
+	pRom->cbChr = 0;
+	pRom->pbChr = nullptr;
+	return pRom;
+}
+
+// CLONE
+//
+// a tree search over inputs: clones of one root machine, each of which then runs a little
+// and dirties a few pages of ram. reports the cost of Clone itself, of the copy on write
+// the first time a clone writes to a shared page, and how much memory the clones hold
+
+int BenchClone(u32 cChildMax)
+{
+	Rom* pRom = PRomSynthetic();
+	Arena& arena = ArenaThread();
+	u64 cbLiveStart = arena.CbLive();
+
+	Nes* pNesRoot = Nes::Create(pRom);
+	pRom->Release();
+
+	// the root has written all of its wram, so there is something to share
+	for (u32 addr = 0; addr < 2 * KB; ++addr)
+	{
+		pNesRoot->Poke((half)addr, (byte)addr);
+	}
+
+	u64 cbRoot = arena.CbLive() - cbLiveStart;
+	printf("sizeof(Nes) %u, root with 2Kb wram written %llu bytes\n\n", (u32)sizeof(Nes), (unsigned long long)cbRoot);
+	printf("%10s %12s %12s %14s %14s %12s\n", "children", "ns/clone", "ns/cow write", "live bytes", "reserved bytes", "bytes/child");
+
+	// each clone writes to this many of its 8 wram pages, as a few frames of a game would
+	static const u32 C_PAGE_DIRTY = 2;
+
+	std::vector<Nes*> aryPNes;
+	aryPNes.reserve(cChildMax);
+
+	u32 seed = 1;
+	for (u32 cChild = 1; cChild <= cChildMax; cChild *= 10)
+	{
+		u32 cChildNew = cChild - (u32)aryPNes.size();
+
+		u64 nsStart = NsNow();
+		for (u32 iChild = 0; iChild < cChildNew; ++iChild)
+		{
+			aryPNes.push_back(pNesRoot->Clone());
+		}
+		u64 nsClone = NsNow() - nsStart;
+
+		nsStart = NsNow();
+		for (u32 iChild = cChild - cChildNew; iChild < cChild; ++iChild)
+		{
+			for (u32 iPage = 0; iPage < C_PAGE_DIRTY; ++iPage)
+			{
+				seed = seed * 1103515245 + 12345;
+				aryPNes[iChild]->Poke((half)((seed >> 8) & 0x07FF), (byte)seed);
+			}
+		}
+		u64 nsWrite = NsNow() - nsStart;
+
+		u64 cbLive = arena.CbLive() - cbLiveStart;
+		printf("%10u %12.1f %12.1f %14llu %14llu %12llu\n",
+			cChild,
+			(double)nsClone / cChildNew,
+			(double)nsWrite / (cChildNew * C_PAGE_DIRTY),
+			(unsigned long long)cbLive,
+			(unsigned long long)arena.CbReserved(),
+			(unsigned long long)((cbLive - cbRoot) / cChild));
+	}
+
+	for (size_t iNes = 0; iNes < aryPNes.size(); ++iNes)
+	{
+		aryPNes[iNes]->Destroy();
+	}
+	pNesRoot->Destroy();
+
+	printf("\nlive bytes after destroying everything %llu\n", (unsigned long long)(arena.CbLive() - cbLiveStart));
+	return 0;
+}
+
+// TRAP
+//
+// the cpu does not advance pc past operands yet, so the program is a chain of jumps,
+// alternating JMP abs and JMP (ind), spread over every page of prg rom. each jump reads
+// the opcode and operand from rom, and the indirect ones a vector from wram
+
+static const u32 C_NODE = 120;
+
+half AddrNode(u32 iNode)
+{
+	return (half)(0x8000 + iNode * PAGE_SIZE + iNode * 37 % 0xF0);
+}
+
+Nes* PNesJumpChain()
+{
+	Rom* pRom = PRomSynthetic();
+	for (u32 iNode = 0; iNode < C_NODE; ++iNode)
+	{
+		byte* pb = pRom->pbPrg + (AddrNode(iNode) - 0x8000);
+		half addrNext = AddrNode((iNode + 1) % C_NODE);
+		half addrVector = (half)(0x0200 + 2 * iNode);
+
+		if (iNode & 1)
+		{
+			pb[0] = 0x6C;	// JMP (ind)
+			pb[1] = (byte)addrVector;
+			pb[2] = (byte)(addrVector >> 8);
+		}
+		else
+		{
+			pb[0] = 0x4C;	// JMP abs
+			pb[1] = (byte)addrNext;
+			pb[2] = (byte)(addrNext >> 8);
+		}
+	}
+
+	// reset vector
+	pRom->pbPrg[0x7FFC] = (byte)AddrNode(0);
+	pRom->pbPrg[0x7FFD] = (byte)(AddrNode(0) >> 8);
+
+	Nes* pNes = Nes::Create(pRom);
+	pRom->Release();
+
+	for (u32 iNode = 1; iNode < C_NODE; iNode += 2)
+	{
+		half addrNext = AddrNode((iNode + 1) % C_NODE);
+		pNes->Poke((half)(0x0200 + 2 * iNode), (byte)addrNext);
+		pNes->Poke((half)(0x0200 + 2 * iNode + 1), (byte)(addrNext >> 8));
+	}
+
+	return pNes;
+}
+
+// best of a few runs, in emulated MHz
+double MhzRun(Nes* pNes)
+{
+	static const u64 C_CYCLE_RUN = 50000000;
+
+	double mhzBest = 0;
+	for (int iRun = 0; iRun < 5; ++iRun)
+	{
+		u64 nsStart = NsNow();
+		pNes->Run(C_CYCLE_RUN);
+		double mhz = C_CYCLE_RUN * 1000.0 / (NsNow() - nsStart);
+		if (mhz > mhzBest)
+			mhzBest = mhz;
+	}
+	return mhzBest;
+}
+
+int BenchTrap()
+{
+#ifdef NO_TRAPS
+	printf("traps compiled out (NO_TRAPS)\n");
+#endif
+
+	Nes* pNes = PNesJumpChain();
+	Debugger debugger;
+
+	printf("%-40s %8.1f MHz\n", "no debugger", MhzRun(pNes));
+
+	pNes->AttachDebugger(&debugger);
+	printf("%-40s %8.1f MHz\n", "debugger attached, nothing set", MhzRun(pNes));
+
+	// wram page 7 is never touched
+	debugger.SetTrap(0x0700, Trap_Exec, true);
+	debugger.SetTrap(0x0701, Trap_Read, true);
+	debugger.SetTrap(0x0702, Trap_Write, true);
+	printf("%-40s %8.1f MHz\n", "traps on a page the code never touches", MhzRun(pNes));
+
+	// the vectors are read from wram page 2, every other jump
+	debugger.SetTrap(0x02FF, Trap_Read, true);
+	printf("%-40s %8.1f MHz\n", "watchpoint on a page the code reads", MhzRun(pNes));
+
+	pNes->Destroy();
+	return 0;
+}
+
+// PPU
+//
+// the program is a JMP to itself, with an NMI handler that is just RTI. between runs of a
+// random length we make random ppu register accesses, the way a game would, with NMI on
+// and off. every value read back, then vram and the palette at the end, go into a hash
+// that has to come out the same inline and threaded
+
+u64 HashPpuRun(bool fThreaded, u32 cStep, u32* pCVblank)
+{
+	Rom* pRom = PRomSynthetic();
+	byte* pbPrg = pRom->pbPrg;
+	pbPrg[0x0000] = 0x4C;	// $8000 JMP $8000
+	pbPrg[0x0001] = 0x00;
+	pbPrg[0x0002] = 0x80;
+	pbPrg[0x0010] = 0x40;	// $8010 RTI
+	pbPrg[0x7FFA] = 0x10;	// nmi
+	pbPrg[0x7FFB] = 0x80;
+	pbPrg[0x7FFC] = 0x00;	// reset
+	pbPrg[0x7FFD] = 0x80;
+
+	Nes* pNes = Nes::Create(pRom);
+	pRom->Release();
+	pNes->SetPpuThreaded(fThreaded);
+
+	u64 hash = 0;
+	u32 cVblank = 0;
+	u32 seed = 7;
+	for (u32 iStep = 0; iStep < cStep; ++iStep)
+	{
+		seed = seed * 1103515245 + 12345;
+		pNes->Run(1 + ((seed >> 8) & 0x3FF));
+
+		seed = seed * 1103515245 + 12345;
+		u32 iReg = (seed >> 8) & 7;
+		byte val = (byte)(seed >> 16);
+		switch (iReg)
+		{
+		case 0:
+			// NMI on most of the time
+			pNes->Write(0x2000, (seed >> 24) & 3 ? val | 0x80 : val & 0x7F);
+			break;
+		case 2:
+		{
+			byte status = pNes->Read(0x2002);
+			if (status & 0x80)
+				cVblank++;
+			hash = hash * 31 + status;
+			break;
+		}
+		case 4:
+		case 7:
+			if (seed >> 31)
+				hash = hash * 31 + pNes->Read((half)(0x2000 + iReg));
+			else
+				pNes->Write((half)(0x2000 + iReg), val);
+			break;
+		default:
+			pNes->Write((half)(0x2000 + iReg), val);
+			break;
+		}
+	}
+
+	// nametables and palette, through $2006/$2007 like everything else
+	pNes->Write(0x2006, 0x20);
+	pNes->Write(0x2006, 0x00);
+	for (u32 addr = 0x2000; addr < 0x3F20; ++addr)
+	{
+		hash = hash * 31 + pNes->Read(0x2007);
+	}
+
+	// and the stack, where the NMIs left their return addresses
+	for (u32 addr = 0x0100; addr < 0x0200; ++addr)
+	{
+		hash = hash * 31 + pNes->Peek((half)addr);
+	}
+
+	pNes->Destroy();
+	*pCVblank = cVblank;
+	return hash;
+}
+
+// the NMI a game leaves on and never thinks about again. $2000 is written once, and the
+// handler does not touch the ppu, so nothing but vblank itself can raise the NMI.
+// a profiler sampling every cycle sees each NMI exactly once, as the instruction it
+// returns with is the RTI
+
+u32 CNmiUntouched(bool fThreaded, u32 cFrame)
+{
+	Rom* pRom = PRomSynthetic();
+	byte* pbPrg = pRom->pbPrg;
+	pbPrg[0x0000] = 0x4C;	// $8000 JMP $8000
+	pbPrg[0x0001] = 0x00;
+	pbPrg[0x0002] = 0x80;
+	pbPrg[0x0010] = 0x40;	// $8010 RTI
+	pbPrg[0x7FFA] = 0x10;	// nmi
+	pbPrg[0x7FFB] = 0x80;
+	pbPrg[0x7FFC] = 0x00;	// reset
+	pbPrg[0x7FFD] = 0x80;
+
+	Nes* pNes = Nes::Create(pRom);
+	pNes->SetPpuThreaded(fThreaded);
+
+	GuestProfiler profiler(pRom, 1);
+	profiler.SetSamplePc(false);
+	pNes->AttachProfiler(&profiler);
+
+	pNes->Write(0x2000, 0x80);
+	pNes->Run((u64)cFrame * C_DOT_SCANLINE * C_SCANLINE_FRAME / C_DOT_CYCLE);
+
+	pNes->AttachProfiler(nullptr);
+	pNes->Destroy();
+	pRom->Release();
+
+	// count the samples whose stack has the NMI in it
+	FILE* pFile = tmpfile();
+	profiler.WriteFolded(pFile);
+	rewind(pFile);
+
+	u32 cNmi = 0;
+	char szLine[256];
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		if (strstr(szLine, ";nmi:"))
+			cNmi += (u32)strtoul(strrchr(szLine, ' ') + 1, nullptr, 10);
+	}
+	fclose(pFile);
+	return cNmi;
+}
+
+int BenchPpu(u32 cStep)
+{
+	// rendering is off, so every frame is the same length, and vblank starts early enough
+	// in the first one that cFrame frames have cFrame NMIs
+	static const u32 C_FRAME_NMI = 60;
+
+	bool fNmiOk = true;
+	for (int iMode = 0; iMode < 2; ++iMode)
+	{
+		u32 cNmi = CNmiUntouched(iMode == 1, C_FRAME_NMI);
+		printf("%-10s %u NMIs in %u frames\n", iMode ? "threaded" : "inline", cNmi, C_FRAME_NMI);
+		if (cNmi != C_FRAME_NMI)
+			fNmiOk = false;
+	}
+
+	u64 aryHash[2];
+	for (int iMode = 0; iMode < 2; ++iMode)
+	{
+		u32 cVblank;
+		u64 nsStart = NsNow();
+		aryHash[iMode] = HashPpuRun(iMode == 1, cStep, &cVblank);
+		printf("%-10s %8.1f ms  vblanks seen %6u  hash %016llx\n",
+			iMode ? "threaded" : "inline",
+			(NsNow() - nsStart) / 1000000.0,
+			cVblank,
+			(unsigned long long)aryHash[iMode]);
+	}
+
+	bool fSame = aryHash[0] == aryHash[1];
+	printf("%s\n", fSame ? "same" : "DIFFERENT");
+	return fSame && fNmiOk ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	const char* szBench = argc > 1 ? argv[1] : "";
+
+	if (!strcmp(szBench, "clone"))
+		return BenchClone(argc > 2 ? (u32)atoi(argv[2]) : 100000);
+
+	if (!strcmp(szBench, "trap"))
+		return BenchTrap();
+
+	if (!strcmp(szBench, "ppu"))
+		return BenchPpu(argc > 2 ? (u32)atoi(argv[2]) : 50000);
+
+	fprintf(stderr, "usage: Bench clone [cChildMax] | trap | ppu [cStep]\n");
+	return 1;
+}
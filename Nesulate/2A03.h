@@ -1,5 +1,7 @@
 #pragma once
 #include "types.h"
+#include "Input.h"
+#include <vector>
 
 // see http://nesdev.com/2A03%20technical%20reference.txt
 
@@ -7,7 +9,18 @@ class CPU_2A03
 {
 public:
 
+	// controller input is pulled from pInputQueue on each strobe and read,
+	// so the game sees input from the cycle it asks for it, not from the start of the frame.
+	// if pInputRecord is set, every event is appended to it restamped with the cycle it was
+	// applied on, so replaying the record gives the exact same run.
+	// the record grows without bound, the owner drains it on the emulation thread
+
+	InputQueue* pInputQueue = nullptr;
+	std::vector<InputEvent>* pInputRecord = nullptr;
+
 private:
+	friend class CPU_6502;
+
 	// PINS (EXTERNAL STATE)
 
 	/*        ________
@@ -80,6 +93,10 @@ private:
 	// decoder logic.
 	void PHI2();
 
+	// PHI2 cycles since power on. timestamps controller input.
+	// PHI2 is not simulated, the 6502 sets this to its cycle count before each access to us
+	u64 cPhi2 = 0;
+
 	// IRQ
 	// interrupts the 6502
 	// - when this pin is on a falling edge (1->0)
@@ -96,19 +113,74 @@ private:
 	// 0=write, 1=read
 	bool RW;
 
-	// 4017R
-	// on a PHI2, if we are writing to $4017
+	// 4016R, 4017R
+	// on a PHI2, if we are reading $4016 or $4017
 	// put controller port data onto data bus
-	void PutControlerData();
+	// bit 0 is the next bit of the controller's shift register,
+	// the rest of the byte is open bus
+	void PutControlerData()
+	{
+		SampleInput();
+
+		byte iPort = A & 1;
+		if (_4016 & 1)
+			aryShift[iPort] = aryButtons[iPort];
+
+		D = (D & 0xE0) | (aryShift[iPort] & 1);
+
+		// after 8 reads an official controller returns 1s
+		aryShift[iPort] = (aryShift[iPort] >> 1) | 0x80;
+	}
 
-	// 4016R
+	// 4016W
 	// on a PHI2, if we are writing to $4016
 	// write to internal 3-bit register
 	// bit 0 is used as a "strobe line" 
 	// for the shift register inside the controller
 	// see https://en.wikipedia.org/wiki/Data_strobe_encoding
-	u8 _4016;
-	void Write4016();
+	u8 _4016 = 0;
+	void Write4016()
+	{
+		SampleInput();
+
+		bool fStrobeLast = (_4016 & 1) != 0;
+		_4016 = D & 0x07;
+
+		// while the strobe is high the controllers continuously reload their 
+		// shift registers, and they latch the buttons as it goes low (1->0). so this
+		// write's input reaches the game on either edge
+		// see http://wiki.nesdev.com/w/index.php/Standard_controller
+		if (fStrobeLast || (_4016 & 1))
+		{
+			aryShift[0] = aryButtons[0];
+			aryShift[1] = aryButtons[1];
+		}
+	}
+
+	// INPUT
+
+	// current button state of each controller port, and its shift register
+	byte aryButtons[2] = { 0, 0 };
+	byte aryShift[2] = { 0, 0 };
+
+	// apply every queued input event that takes effect on or before this cycle
+	void SampleInput()
+	{
+		if (!pInputQueue)
+			return;
+
+		InputEvent ev;
+		while (pInputQueue->FPop(cPhi2, &ev))
+		{
+			aryButtons[ev.iPort & 1] = ev.buttons;
+
+			if (pInputRecord)
+			{
+				ev.cycle = cPhi2;
+				pInputRecord->push_back(ev);
+			}
+		}
+	}
 
 	// INTERNAL STATE
 
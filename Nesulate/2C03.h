@@ -0,0 +1,326 @@
+#pragma once
+#include "Types.h"
+#include "Memory.h"
+#include "nesfile.h"
+
+// see https://wiki.nesdev.com/w/index.php/PPU
+// and https://wiki.nesdev.com/w/index.php/PPU_memory_map
+
+// dots (ppu cycles) per scanline and scanlines per frame.
+// 3 dots per cpu cycle
+#define C_DOT_SCANLINE 341
+#define C_SCANLINE_FRAME 262
+#define C_DOT_CYCLE 3
+
+class PPU_2C03
+{
+public:
+
+private:
+	friend class Nes;
+	friend class CPU_6502;
+	friend class PpuThread;
+
+	// MEMORY
+	// only memory we can write is owned by this instance,
+	// chr rom is read straight from the cartridge shared by every machine
+
+	// $0000-$1FFF pattern tables, chr rom on the cartridge, or chr ram if it has none.
+	// chr ram is never materialized if not written
+	Rom* pRom = nullptr;	// owned by the Nes
+	CowMemory<8 * KB / PAGE_SIZE> chrRam;
+
+	// $2000-$2FFF name tables, 2Kb of vram inside the console, mirrored by the cartridge.
+	// $3000-$3EFF mirrors $2000-$2EFF
+	CowMemory<2 * KB / PAGE_SIZE> vram;
+
+	// $3F00-$3F1F palette ram indexes, mirrored up to $3FFF
+	byte aryPalette[32];
+
+	// object attribute memory, 64 sprites of 4 bytes each. 
+	// on its own bus, accessed through $2003/$2004 and OAM DMA
+	byte aryOam[256];
+
+	byte ReadVram(half addr)
+	{
+		addr &= 0x3FFF;
+
+		if (addr < 0x2000)
+			return pRom->cbChr ? pRom->ReadChr(addr) : chrRam.Read(addr);
+
+		if (addr < 0x3F00)
+			return vram.Read(AddrNametable(addr));
+
+		return aryPalette[IPalette(addr)];
+	}
+
+	void WriteVram(half addr, byte val)
+	{
+		addr &= 0x3FFF;
+
+		if (addr < 0x2000)
+		{
+			if (!pRom->cbChr)
+				chrRam.Write(addr, val);
+		}
+		else if (addr < 0x3F00)
+		{
+			vram.Write(AddrNametable(addr), val);
+		}
+		else
+		{
+			aryPalette[IPalette(addr)] = val;
+		}
+	}
+
+	// 4 logical name tables of 1Kb in 2Kb of vram
+	half AddrNametable(half addr)
+	{
+		int iTable = (addr >> 10) & 3;
+		int iTableVram = pRom->fVerticalMirroring ? (iTable & 1) : (iTable >> 1);
+		return (half)((iTableVram << 10) | (addr & 0x03FF));
+	}
+
+	// $3F10/$3F14/$3F18/$3F1C mirror $3F00/$3F04/$3F08/$3F0C
+	static int IPalette(half addr)
+	{
+		int iPalette = addr & 0x1F;
+		if ((iPalette & 0x13) == 0x10)
+			iPalette &= ~0x10;
+		return iPalette;
+	}
+
+	// REGISTERS
+	// $2000-$2007, mirrored every 8 bytes up to $3FFF
+	// see https://wiki.nesdev.com/w/index.php/PPU_registers
+
+	byte ctrl = 0;			// $2000
+	byte mask = 0;			// $2001
+	byte status = 0;		// $2002, top 3 bits. vblank, sprite 0 hit, sprite overflow
+	byte oamAddr = 0;		// $2003
+	byte readBuffer = 0;	// $2007 reads are delayed by one
+	byte ioLatch = 0;		// last value on the data bus, read back from write only registers
+
+	// scrolling and address registers
+	// see https://wiki.nesdev.com/w/index.php/PPU_scrolling
+	half v = 0;				// current vram address
+	half t = 0;				// temporary vram address
+	byte xFine = 0;
+	bool w = false;			// first or second write of $2005/$2006
+
+	enum PpuCtrl : byte
+	{
+		PpuCtrl_Increment32	= 1 << 2,
+		PpuCtrl_Nmi			= 1 << 7,
+	};
+
+	enum PpuMask : byte
+	{
+		PpuMask_Background	= 1 << 3,
+		PpuMask_Sprites		= 1 << 4,
+	};
+
+	enum PpuStatus : byte
+	{
+		PpuStatus_Vblank	= 1 << 7,
+	};
+
+	byte ReadRegister(half addr)
+	{
+		switch (addr & 7)
+		{
+		case 2:
+			ioLatch = (status & 0xE0) | (ioLatch & 0x1F);
+			status &= ~PpuStatus_Vblank;
+			w = false;
+			break;
+		case 4:
+			ioLatch = aryOam[oamAddr];
+			break;
+		case 7:
+			if ((v & 0x3FFF) < 0x3F00)
+			{
+				ioLatch = readBuffer;
+				readBuffer = ReadVram(v);
+			}
+			else
+			{
+				// palette reads are not delayed, the buffer gets the name table underneath
+				ioLatch = ReadVram(v);
+				readBuffer = ReadVram(v - 0x1000);
+			}
+			v += (ctrl & PpuCtrl_Increment32) ? 32 : 1;
+			break;
+		default:
+			// write only
+			break;
+		}
+
+		return ioLatch;
+	}
+
+	void WriteRegister(half addr, byte val)
+	{
+		ioLatch = val;
+
+		switch (addr & 7)
+		{
+		case 0:
+			// turning NMI on during vblank raises it straight away
+			if (!(ctrl & PpuCtrl_Nmi) && (val & PpuCtrl_Nmi) && (status & PpuStatus_Vblank))
+				fNmiPending = true;
+			ctrl = val;
+			t = (t & 0xF3FF) | ((val & 0x03) << 10);
+			break;
+		case 1:
+			mask = val;
+			break;
+		case 2:
+			// read only
+			break;
+		case 3:
+			oamAddr = val;
+			break;
+		case 4:
+			aryOam[oamAddr++] = val;
+			break;
+		case 5:
+			if (!w)
+			{
+				t = (t & ~0x001F) | (val >> 3);
+				xFine = val & 0x07;
+			}
+			else
+			{
+				t = (t & ~0x73E0) | ((val & 0x07) << 12) | ((val & 0xF8) << 2);
+			}
+			w = !w;
+			break;
+		case 6:
+			if (!w)
+			{
+				t = (t & 0x00FF) | ((val & 0x3F) << 8);
+			}
+			else
+			{
+				t = (t & 0xFF00) | val;
+				v = t;
+			}
+			w = !w;
+			break;
+		case 7:
+			WriteVram(v, val);
+			v += (ctrl & PpuCtrl_Increment32) ? 32 : 1;
+			break;
+		}
+	}
+
+	// $4014, 256 bytes from a cpu page into oam starting at oamAddr
+	void WriteOamDma(const byte* aryByte)
+	{
+		for (int ib = 0; ib < 256; ++ib)
+		{
+			aryOam[oamAddr++] = aryByte[ib];
+		}
+	}
+
+	// TIMING
+
+	// position of the next dot to run.
+	// scanlines 0-239 are visible, 240 is idle, 241-260 are vblank, 261 is the pre-render line
+	half scanline = 0;
+	half dot = 0;
+	bool fOddFrame = false;
+
+	// dots run since power on
+	u64 cDot = 0;
+
+	bool FRendering()
+	{
+		return (mask & (PpuMask_Background | PpuMask_Sprites)) != 0;
+	}
+
+	// /NMI going low, latched until the cpu takes it. the cpu only looks at the ppu at
+	// register accesses and at the dot CDotNextNmi predicts, so it cannot see the edge
+	// itself: by then /NMI may have been high since the last frame, with nothing in
+	// between to see it go back low at the end of vblank
+	// see https://wiki.nesdev.com/w/index.php/NMI
+	bool fNmiPending = false;
+
+	bool FTakeNmi()
+	{
+		bool fNmi = fNmiPending;
+		fNmiPending = false;
+		return fNmi;
+	}
+
+	void RunTo(u64 cDotTarget)
+	{
+		while (cDot < cDotTarget)
+		{
+			Tick();
+		}
+	}
+
+	void Tick()
+	{
+		// background and sprite rendering go here
+
+		if (dot == 1)
+		{
+			if (scanline == 241)
+			{
+				status |= PpuStatus_Vblank;
+				if (ctrl & PpuCtrl_Nmi)
+					fNmiPending = true;
+			}
+			else if (scanline == 261)
+				status &= ~0xE0;
+		}
+
+		cDot++;
+		dot++;
+
+		// odd frames skip the last dot of the pre-render line while rendering
+		if (scanline == 261 && dot == 340 && fOddFrame && FRendering())
+			dot++;
+
+		if (dot == C_DOT_SCANLINE)
+		{
+			dot = 0;
+			scanline++;
+			if (scanline == C_SCANLINE_FRAME)
+			{
+				scanline = 0;
+				fOddFrame = !fOddFrame;
+			}
+		}
+	}
+
+	// the value of cDot once /NMI next goes high, if nothing is written to the registers
+	// before then. ~0 if it will not
+	u64 CDotNextNmi()
+	{
+		if (!(ctrl & PpuCtrl_Nmi))
+			return ~0ull;
+
+		int iDot = scanline * C_DOT_SCANLINE + dot;
+		int iDotVblank = 241 * C_DOT_SCANLINE + 1;
+		int iDotFrame = C_SCANLINE_FRAME * C_DOT_SCANLINE;
+
+		u64 cDotUntil;
+		if (iDot <= iDotVblank)
+		{
+			cDotUntil = iDotVblank - iDot;
+		}
+		else
+		{
+			// through the pre-render line, and maybe its skipped dot
+			cDotUntil = iDotFrame - iDot + iDotVblank;
+			if (fOddFrame && FRendering() && iDot < 261 * C_DOT_SCANLINE + 340)
+				cDotUntil--;
+		}
+
+		return cDot + cDotUntil + 1;
+	}
+};
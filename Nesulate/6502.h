@@ -1,18 +1,236 @@
+#pragma once
 #include "Types.h"
+#include "Memory.h"
+#include "nesfile.h"
+#include "2A03.h"
+#include "2C03.h"
+#include "PpuThread.h"
+#include "Profiler.h"
 #include <cassert>
 
 
+// http://www.obelisk.me.uk/6502/reference.html
+
+enum OpCode : byte
+{
+	OP_ADC, // Add with Carry
+	OP_AND, // Logical AND
+	OP_ASL, // Arithmetic Shift Left
+	OP_BCC, // Branch if Carry Clear
+	OP_BCS, // Branch if Carry Set
+	OP_BEQ, // Branch if Equal
+	OP_BIT, // Bit Test
+	OP_BMI, // Branch if Minus
+	OP_BNE, // Branch if Not Equal
+	OP_BPL, // Branch if Positive
+	OP_BRK, // Force Interrupt
+	OP_BVC, // Branch if Overflow Clear
+	OP_BVS, // Branch if Overflow Set
+	OP_CLC, // Clear Carry Flag
+	OP_CLD, // Clear Decimal Mode
+	OP_CLI, // Clear Interrupt Disable
+	OP_CLV, // Clear Overflow Flag
+	OP_CMP, // Compare
+	OP_CPX, // Compare X Register
+	OP_CPY, // Compare Y Register
+	OP_DEC, // Decrement Memory
+	OP_DEX, // Decrement X Register
+	OP_DEY, // Decrement Y Register
+	OP_EOR, // Exclusive OR
+	OP_INC, // Increment Memory
+	OP_INX, // Increment X Register
+	OP_INY, // Increment Y Register
+	OP_JMP, // Jump
+	OP_JSR, // Jump to Subroutine
+	OP_LDA, // Load Accumulator
+	OP_LDX, // Load X Register
+	OP_LDY, // Load Y Register
+	OP_LSR, // Logical Shift Right
+	OP_NOP, // NOP
+	OP_ORA, // Logical Inclusive OR
+	OP_PHA, // Push Accumulator
+	OP_PHP, // Push Processor Status
+	OP_PLA, // Pull Accumulator
+	OP_PLP, // Pull Processor Status
+	OP_ROL, // Rotate Left
+	OP_ROR, // Rotate Right
+	OP_RTI, // Return from Interrupt
+	OP_RTS, // Return from Subroutine
+	OP_SBC, // Subtract with Carry
+	OP_SEC, // Set Carry Flag
+	OP_SED, // Set Decimal Flag
+	OP_SEI, // Set Interrupt Disable
+	OP_STA, // Store Accumulator
+	OP_STX, // Store X Register
+	OP_STY, // Store Y Register
+	OP_TAX, // Transfer Accumulator to X
+	OP_TAY, // Transfer Accumulator to Y
+	OP_TSX, // Transfer Stack Pointer to X
+	OP_TXA, // Transfer X to Accumulator
+	OP_TXS, // Transfer X to Stack Pointer
+	OP_TYA, // Transfer Y to Accumulator
+
+	OP_INVALID,
+};
+
+// http://www.obelisk.me.uk/6502/addressing.html
+
+enum AddresingMode : byte
+{
+	AM_Imp,		// Implicit
+	AM_Acc,		// Accumulator
+	AM_Imm,		// Immediate
+	AM_ZP,		// Zero Page
+	AM_ZPX,		// Zero Page, X
+	AM_ZPY,		// Zero Page, Y
+	AM_Rel,		// Relative
+	AM_Abs,		// Absolute
+	AM_AbsX,	// Absolute, X
+	AM_AbsY,	// Absolute, Y
+	AM_Ind,		// Indirect
+	AM_IndX,	// Indirect, X
+	AM_IndY		// Indirect, Y
+};
+
+struct IntructionInfo
+{
+	OpCode op;
+	AddresingMode am;
+};
+
+#define INST_INVALID_______ {OP_INVALID, AM_Imp}
+
+// lookup table that converts from byte to opcode and addressing mode
+
+const IntructionInfo aryInsti[256] =
+{
+	// http://www.llx.com/~nparker/a2/opcodes.html
+	// http://www.obelisk.me.uk/6502/reference.html
+	// https://en.wikipedia.org/wiki/MOS_Technology_6502#Assembly_language_instructions
+	/*  | x0                 | x1                 | x2                 | x3                 | x4                 | x5                 | x6                 | x7                 | x8                 | x9                 | xA                 | xB                 | xC                 | xD                 | xE                 | xF                 |*/
+	/*0x*/{ OP_BRK, AM_Imp  }, { OP_ORA, AM_IndX }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_ZP   }, { OP_ASL, AM_ZP   }, INST_INVALID_______, { OP_PHP, AM_Imp  }, { OP_ORA, AM_Imm  }, { OP_ASL, AM_Acc  }, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_Abs  }, { OP_ASL, AM_Abs  }, INST_INVALID_______,
+	/*1x*/{ OP_BPL, AM_Rel  }, { OP_ORA, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_ZPX  }, { OP_ASL, AM_ZPX  }, INST_INVALID_______, { OP_CLC, AM_Imp  }, { OP_ORA, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_AbsX }, { OP_ASL, AM_AbsX }, INST_INVALID_______,
+	/*2x*/{ OP_JSR, AM_Abs  }, { OP_AND, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_BIT, AM_ZP   }, { OP_AND, AM_ZP   }, { OP_ROL, AM_ZP   }, INST_INVALID_______, { OP_PLP, AM_Imp  }, { OP_AND, AM_Imm  }, { OP_ROL, AM_Acc  }, INST_INVALID_______, { OP_BIT, AM_Abs  }, { OP_AND, AM_Abs  }, { OP_ROL, AM_Abs  }, INST_INVALID_______,
+	/*3x*/{ OP_BMI, AM_Rel  }, { OP_AND, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_AND, AM_ZPX  }, { OP_ROL, AM_ZPX  }, INST_INVALID_______, { OP_SEC, AM_Imp  }, { OP_AND, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_AND, AM_AbsX }, { OP_ROL, AM_AbsX }, INST_INVALID_______,
+	/*4x*/{ OP_RTI, AM_Imp  }, { OP_EOR, AM_IndX }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_EOR, AM_ZP   }, { OP_LSR, AM_ZP   }, INST_INVALID_______, { OP_PHA, AM_Imp  }, { OP_EOR, AM_Imm  }, { OP_LSR, AM_Acc  }, INST_INVALID_______, { OP_JMP, AM_Abs  }, { OP_EOR, AM_Abs  }, { OP_LSR, AM_Abs  }, INST_INVALID_______,
+	/*5x*/{ OP_BVC, AM_Rel  }, { OP_EOR, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_EOR, AM_ZPX  }, { OP_LSR, AM_ZPX  }, INST_INVALID_______, { OP_CLI, AM_Imp  }, { OP_EOR, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_EOR, AM_AbsX }, { OP_LSR, AM_AbsX }, INST_INVALID_______,
+	/*6x*/{ OP_RTS, AM_Imp  }, { OP_ADC, AM_IndX }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ADC, AM_ZP   }, { OP_ROR, AM_ZP   }, INST_INVALID_______, { OP_PLA, AM_Imp  }, { OP_ADC, AM_Imm  }, { OP_ROR, AM_Acc  }, INST_INVALID_______, { OP_JMP, AM_Ind  }, { OP_ADC, AM_Abs  }, { OP_ROR, AM_Abs  }, INST_INVALID_______,
+	/*7x*/{ OP_BVS, AM_Rel  }, { OP_ADC, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ADC, AM_ZPX  }, { OP_ROR, AM_ZPX  }, INST_INVALID_______, { OP_SEI, AM_Imp  }, { OP_ADC, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ADC, AM_AbsX }, { OP_ROR, AM_AbsX }, INST_INVALID_______,
+	/*8x*/INST_INVALID_______, { OP_STA, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_STY, AM_ZP   }, { OP_STA, AM_ZP   }, { OP_STX, AM_ZP   }, INST_INVALID_______, { OP_DEY, AM_Imp  }, INST_INVALID_______, { OP_TXA, AM_Imp  }, INST_INVALID_______, { OP_STY, AM_Abs  }, { OP_STA, AM_Abs  }, { OP_STX, AM_Abs  }, INST_INVALID_______,
+	/*9x*/{ OP_BCC, AM_Rel  }, { OP_STY, AM_IndY }, INST_INVALID_______, INST_INVALID_______, { OP_STY, AM_ZPX  }, { OP_STA, AM_ZPX  }, { OP_STX, AM_ZPY  }, INST_INVALID_______, { OP_TYA, AM_Imp  }, { OP_STA, AM_AbsY }, { OP_TXS, AM_Imp  }, INST_INVALID_______, INST_INVALID_______, { OP_STA, AM_AbsX }, INST_INVALID_______, INST_INVALID_______,
+	/*Ax*/{ OP_LDY, AM_Imm  }, { OP_LDA, AM_IndX }, { OP_LDX, AM_Imm  }, INST_INVALID_______, { OP_LDY, AM_ZP   }, { OP_LDA, AM_ZP   }, { OP_LDX, AM_ZP   }, INST_INVALID_______, { OP_TAY, AM_Imp  }, { OP_LDA, AM_Imm  }, { OP_TAX, AM_Imp  }, INST_INVALID_______, { OP_LDY, AM_Abs  }, { OP_LDA, AM_Abs  }, { OP_LDX, AM_Abs  }, INST_INVALID_______,
+	/*Bx*/{ OP_BCS, AM_Rel  }, { OP_LDA, AM_IndY }, INST_INVALID_______, INST_INVALID_______, { OP_LDY, AM_ZPX  }, { OP_LDA, AM_ZPX  }, { OP_LDX, AM_ZPY  }, INST_INVALID_______, { OP_CLV, AM_Imp  }, { OP_LDA, AM_AbsY }, { OP_TSX, AM_Imp  }, INST_INVALID_______, { OP_LDY, AM_AbsX }, { OP_LDA, AM_AbsX }, { OP_LDX, AM_AbsY }, INST_INVALID_______,
+	/*Cx*/{ OP_CPY, AM_Imm  }, { OP_CMP, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_CPY, AM_ZP   }, { OP_CMP, AM_ZP   }, { OP_DEC, AM_ZP   }, INST_INVALID_______, { OP_INY, AM_Imp  }, { OP_CMP, AM_Imm  }, { OP_DEX, AM_Imp  }, INST_INVALID_______, { OP_CPY, AM_Abs  }, { OP_CMP, AM_Abs  }, { OP_DEC, AM_Abs  }, INST_INVALID_______,
+	/*Dx*/{ OP_BNE, AM_Rel  }, { OP_CMP, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_CMP, AM_ZPX  }, { OP_DEC, AM_ZPX  }, INST_INVALID_______, { OP_CLD, AM_Imp  }, { OP_CMP, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_CMP, AM_AbsX }, { OP_DEC, AM_AbsX }, INST_INVALID_______,
+	/*Ex*/{ OP_CPX, AM_Imm  }, { OP_SBC, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_CPX, AM_ZP   }, { OP_SBC, AM_ZP   }, { OP_INC, AM_ZP   }, INST_INVALID_______, { OP_INX, AM_Imp  }, { OP_SBC, AM_Imm  }, { OP_NOP, AM_Imp  }, INST_INVALID_______, { OP_CPX, AM_Abs  }, { OP_SBC, AM_Abs  }, { OP_INC, AM_Abs  }, INST_INVALID_______,
+	/*Fx*/{ OP_BEQ, AM_Rel  }, { OP_SBC, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_SBC, AM_ZPX  }, { OP_INC, AM_ZPX  }, INST_INVALID_______, { OP_SED, AM_Imp  }, { OP_SBC, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_SBC, AM_AbsX }, { OP_INC, AM_AbsX }, INST_INVALID_______,
+};
+
+#undef INST_INVALID
+
+// cycles taken by each instruction, not counting the extra cycle for crossing a page
+// or taking a branch. the unofficial opcodes we do not run yet take 2, like a NOP,
+// so time still moves and Nes::Run returns
+
+const byte aryCycle[256] =
+{
+	/*  | x0| x1| x2| x3| x4| x5| x6| x7| x8| x9| xA| xB| xC| xD| xE| xF|*/
+	/*0x*/ 7,  6,  2,  2,  2,  3,  5,  2,  3,  2,  2,  2,  2,  4,  6,  2,
+	/*1x*/ 2,  5,  2,  2,  2,  4,  6,  2,  2,  4,  2,  2,  2,  4,  7,  2,
+	/*2x*/ 6,  6,  2,  2,  3,  3,  5,  2,  4,  2,  2,  2,  4,  4,  6,  2,
+	/*3x*/ 2,  5,  2,  2,  2,  4,  6,  2,  2,  4,  2,  2,  2,  4,  7,  2,
+	/*4x*/ 6,  6,  2,  2,  2,  3,  5,  2,  3,  2,  2,  2,  3,  4,  6,  2,
+	/*5x*/ 2,  5,  2,  2,  2,  4,  6,  2,  2,  4,  2,  2,  2,  4,  7,  2,
+	/*6x*/ 6,  6,  2,  2,  2,  3,  5,  2,  4,  2,  2,  2,  5,  4,  6,  2,
+	/*7x*/ 2,  5,  2,  2,  2,  4,  6,  2,  2,  4,  2,  2,  2,  4,  7,  2,
+	/*8x*/ 2,  6,  2,  2,  3,  3,  3,  2,  2,  2,  2,  2,  4,  4,  4,  2,
+	/*9x*/ 2,  6,  2,  2,  4,  4,  4,  2,  2,  5,  2,  2,  2,  5,  2,  2,
+	/*Ax*/ 2,  6,  2,  2,  3,  3,  3,  2,  2,  2,  2,  2,  4,  4,  4,  2,
+	/*Bx*/ 2,  5,  2,  2,  4,  4,  4,  2,  2,  4,  2,  2,  4,  4,  4,  2,
+	/*Cx*/ 2,  6,  2,  2,  3,  3,  5,  2,  2,  2,  2,  2,  4,  4,  6,  2,
+	/*Dx*/ 2,  5,  2,  2,  2,  4,  6,  2,  2,  4,  2,  2,  2,  4,  7,  2,
+	/*Ex*/ 2,  6,  2,  2,  3,  3,  5,  2,  2,  2,  2,  2,  4,  4,  6,  2,
+	/*Fx*/ 2,  5,  2,  2,  2,  4,  6,  2,  2,  4,  2,  2,  2,  4,  7,  2,
+};
+
+inline const IntructionInfo InstiFromByte(byte instruction)
+{
+	return aryInsti[instruction];
+}
+
 //http://www.obelisk.me.uk/6502/index.html
 
+// breakpoints and watchpoints. the cpu keeps a table of these flags per 256 byte page,
+// and only calls its TrapHandler when it touches a flagged page.
+//
+// the same table marks the pages the bus has to route somewhere special (ppu and io
+// registers), and an access only looks further when its page has any flag set. so with
+// no traps set the cpu makes exactly the checks it would make without a debugger
+
+enum Trap : byte
+{
+	Trap_Exec	= 1 << 0,
+	Trap_Read	= 1 << 1,
+	Trap_Write	= 1 << 2,
+
+	Trap_Io		= 1 << 7,	// not a trap. $2000-$3FFF ppu registers, $4000-$40FF apu and io
+};
+
+// build with NO_TRAPS to leave breakpoints and watchpoints out of the cpu, to measure
+// what they cost. a Debugger can still attach, it just never stops the machine
+
+#ifdef NO_TRAPS
+#define TRAP_MASK 0
+#else
+#define TRAP_MASK (Trap_Exec | Trap_Read | Trap_Write)
+#endif
+
+class TrapHandler
+{
+public:
+	// about to execute the instruction at pc, on a page flagged Trap_Exec
+	virtual void OnExec(half pc) = 0;
+
+	// about to read or write addr, on a page flagged for that access
+	virtual void OnAccess(half addr, Trap trap) = 0;
+};
+
 class CPU_6502
 {
 public:
 
 private:
+	friend class Nes;
+	friend class Debugger;
 
-	// capable of addressing at most 64Kb of memory via 16 bit address bus
-	
-	byte ram[64 * KB];
+	// see Trap
+
+	static const byte* AryTrapNone()
+	{
+		#define IO Trap_Io
+		static const byte s_aryTrapNone[64 * KB / PAGE_SIZE] =
+		{
+			/*  | x0| x1| x2| x3| x4| x5| x6| x7| x8| x9| xA| xB| xC| xD| xE| xF|*/
+			/*0x*/ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+			/*1x*/ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+			/*2x*/IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO,
+			/*3x*/IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO, IO,
+			/*4x*/IO,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+			// $5000-$FFFF all 0
+		};
+		#undef IO
+		return s_aryTrapNone;
+	}
+
+	const byte* aryPageTrap = AryTrapNone();
+	TrapHandler* pTrapHandler = nullptr;
+
+	// see GuestProfiler, null when not profiling
+	GuestProfiler* pProfiler = nullptr;
+
+	// capable of addressing at most 64Kb of memory via 16 bit address bus,
+	// but in the NES only 2Kb of that is ram inside the console.
+	// see https://wiki.nesdev.com/w/index.php/CPU_memory_map
 
 	// The first 256 byte page of memory ($0000-$00FF) is referred to as 
 	// 'Zero Page' and is the focus of a number of special addressing modes
@@ -26,9 +244,9 @@ private:
 	
 	half halfAt(half addr)
 	{
-		// both The 6502 and x86 are little endian, so this works 
-		
-		return *((half*)(ram + addr));
+		// little endian. read a byte at a time, addr and addr + 1 may be on different pages
+
+		return Read(addr) | (Read(addr + 1) << 8);
 	}
 
 	// non-maskable interrupt handler
@@ -54,12 +272,12 @@ private:
 
 	// registers
 	
-	half pc;
+	half pc = 0;
 	half sp = 0x01FF;	// points to next free location on the stack. 
 						//intitaly points to beggining (top) of stack. decremented on push, incremented on pop. 
-	byte acc;
-	byte iX;
-	byte iY;
+	byte acc = 0;
+	byte iX = 0;
+	byte iY = 0;
 
 	// status flags
 
@@ -98,9 +316,243 @@ private:
 
 	byte status = 0x20;
 
+	// memory map. only memory we can write is owned by this instance,
+	// rom is read straight from the cartridge shared by every machine
+
+	CowMemory<2 * KB / PAGE_SIZE> wram;		// $0000-$07FF, mirrored up to $1FFF
+	CowMemory<8 * KB / PAGE_SIZE> prgRam;	// $6000-$7FFF, on the cartridge. never materialized if not written
+	Rom* pRom = nullptr;					// $8000-$FFFF, owned by the Nes
+
+	byte Read(half addr)
+	{
+		if (aryPageTrap[addr >> 8] & ((Trap_Read & TRAP_MASK) | Trap_Io))
+			return ReadSlow(addr);
+
+		return Peek(addr);
+	}
+
+	void Write(half addr, byte val)
+	{
+		if (aryPageTrap[addr >> 8] & ((Trap_Write & TRAP_MASK) | Trap_Io))
+			WriteSlow(addr, val);
+		else
+			Poke(addr, val);
+	}
+
+	// fetch the opcode at pc, stopping first if there is a breakpoint on its page
+	byte Fetch()
+	{
+		if (aryPageTrap[pc >> 8] & (((Trap_Exec | Trap_Read) & TRAP_MASK) | Trap_Io))
+		{
+			if (aryPageTrap[pc >> 8] & Trap_Exec & TRAP_MASK)
+				pTrapHandler->OnExec(pc);
+
+			// the handler may have moved pc
+			return Read(pc);
+		}
+
+		return Peek(pc);
+	}
+
+	byte ReadSlow(half addr)
+	{
+		if (aryPageTrap[addr >> 8] & Trap_Read & TRAP_MASK)
+			pTrapHandler->OnAccess(addr, Trap_Read);
+
+		if ((addr & 0xE000) == 0x2000)
+			return ReadPpu(addr);
+
+		if ((addr & 0xFFFE) == 0x4016)
+			return ReadController(addr);
+
+		return Peek(addr);
+	}
+
+	void WriteSlow(half addr, byte val)
+	{
+		if (aryPageTrap[addr >> 8] & Trap_Write & TRAP_MASK)
+			pTrapHandler->OnAccess(addr, Trap_Write);
+
+		if ((addr & 0xE000) == 0x2000)
+			WritePpu(addr, val);
+		else if (addr == 0x4014)
+			OamDma(val);
+		else if (addr == 0x4016)
+			WriteStrobe(val);
+		else
+			Poke(addr, val);
+	}
+
+	// Read and Write without traps, for the debugger
+
+	byte Peek(half addr)
+	{
+		if (addr < 0x2000)
+			return wram.Read(addr & 0x07FF);
+
+		if (addr >= 0x8000)
+			return pRom->ReadPrg(addr);
+
+		if (addr >= 0x6000)
+			return prgRam.Read(addr - 0x6000);
+
+		// $2000-$3FFF ppu registers and $4016/$4017 controllers have side effects, they only go
+		// through Read and Write. the rest of $4000-$401F apu and io registers,
+		// $4020-$5FFF expansion rom. not routed yet, open bus
+
+		return 0;
+	}
+
+	void Poke(half addr, byte val)
+	{
+		if (addr < 0x2000)
+			wram.Write(addr & 0x07FF, val);
+		else if (addr >= 0x6000 && addr < 0x8000)
+			prgRam.Write(addr - 0x6000, val);
+	}
+
+	// CONTROLLERS
+	// $4016 and $4017 are wired to the 2A03's controller pins.
+	// cCycle is already at the end of the instruction, which is where the access lands
+
+	CPU_2A03* p2A03 = nullptr;	// owned by the Nes
+
+	byte ReadController(half addr)
+	{
+		p2A03->cPhi2 = cCycle;
+		p2A03->A = addr;
+		p2A03->D = addr >> 8;	// open bus, the last thing on the bus was the address' high byte
+		p2A03->PutControlerData();
+		return p2A03->D;
+	}
+
+	void WriteStrobe(byte val)
+	{
+		p2A03->cPhi2 = cCycle;
+		p2A03->A = 0x4016;
+		p2A03->D = val;
+		p2A03->Write4016();
+	}
+
+	// PPU
+	// the ppu is caught up lazily, only when we touch its registers, do OAM DMA, or reach
+	// the cycle its next NMI is due. with a PpuThread it runs alongside us instead, and
+	// those same points are where we wait for it
+
+	PPU_2C03* pPpu = nullptr;			// owned by the Nes
+	PpuThread* pPpuThread = nullptr;	// owned by the Nes, null to run the ppu inline
+
+	u64 cCycle = 0;				// cpu cycles since power on
+	u64 cCycleNmi = ~0ull;		// cycle the ppu's next NMI is due by
+	u64 cCycleSync = ~0ull;		// next cycle to call Sync. cCycleNmi, or sooner to publish to a PpuThread or take a profiler sample
+
+	// how often to let a PpuThread know how far we have got
+	static const u64 C_CYCLE_PUBLISH = 64;
+
+	void CatchUpPpu()
+	{
+		if (pPpuThread)
+			pPpuThread->CatchUp(cCycle);
+		else
+			pPpu->RunTo(cCycle * C_DOT_CYCLE);
+	}
+
+	// a register access can change /NMI or when the next one is due,
+	// so check at the end of this instruction
+	void SyncPpuSoon()
+	{
+		cCycleNmi = cCycle;
+		cCycleSync = cCycle;
+	}
+
+	byte ReadPpu(half addr)
+	{
+		CatchUpPpu();
+		byte val = pPpu->ReadRegister(addr);
+		SyncPpuSoon();
+		return val;
+	}
+
+	void WritePpu(half addr, byte val)
+	{
+		CatchUpPpu();
+		pPpu->WriteRegister(addr, val);
+		SyncPpuSoon();
+	}
+
+	// $4014, copy a page to oam
+	void OamDma(byte val)
+	{
+		byte aryByte[256];
+		for (int ib = 0; ib < 256; ++ib)
+		{
+			aryByte[ib] = Read((val << 8) | ib);
+		}
+
+		CatchUpPpu();
+		pPpu->WriteOamDma(aryByte);
+		SyncPpuSoon();
+
+		// the cpu is halted for the copy, plus one cycle to line up on an even cycle
+		cCycle += 513 + (cCycle & 1);
+	}
+
+	// everything that happens on a cycle deadline, so Cycle only has the one compare to make
+
+	void Sync()
+	{
+		if (pPpuThread)
+			pPpuThread->Publish(cCycle);
+
+		if (cCycle >= cCycleNmi)
+		{
+			CatchUpPpu();
+
+			// /NMI is edge triggered, the ppu latches the edge for us
+			bool fNmi = pPpu->FTakeNmi();
+
+			u64 cDotNmi = pPpu->CDotNextNmi();
+			cCycleNmi = (cDotNmi == ~0ull) ? ~0ull : (cDotNmi + C_DOT_CYCLE - 1) / C_DOT_CYCLE;
+
+			if (fNmi)
+				Nmi();
+		}
+
+		if (pProfiler && cCycle >= pProfiler->CCycleNext())
+			pProfiler->Sample(pc, cCycle);
+
+		cCycleSync = cCycleNmi;
+		if (pPpuThread && cCycle + C_CYCLE_PUBLISH < cCycleSync)
+			cCycleSync = cCycle + C_CYCLE_PUBLISH;
+		if (pProfiler && pProfiler->CCycleNext() < cCycleSync)
+			cCycleSync = pProfiler->CCycleNext();
+	}
+
+	void Nmi()
+	{
+		// like BRK, but pushed by an interupt. PCH, PCL, then P
+		// see http://wiki.nesdev.com/w/index.php/CPU_interrupts
+		Write(sp, (byte)(pc >> 8));
+		Write(sp - 1, (byte)pc);
+		Write(sp - 2, status & ~StatusFlag_PushSource);
+		sp -= 3;
+		status |= StatusFlag_InteruptDisable;
+		pc = pNMIHandler();
+		cCycle += 7;
+
+		if (pProfiler)
+			pProfiler->OnCall(pc, sp, FrameKind_Nmi);
+	}
+
 	void Cycle()
 	{
-		IntructionInfo insti = InstiFromByte(ram[pc]);
+		byte opcode = Fetch();
+		IntructionInfo insti = InstiFromByte(opcode);
+
+		// count the instruction's cycles up front, so a register access during it catches
+		// the ppu up to the end of the instruction, which is where most accesses land
+
+		cCycle += aryCycle[opcode];
 
 		// get the address provided by the addressing mode
 
@@ -112,21 +564,26 @@ private:
 		// one mem read
 
 		case OP_ADC:
-			byte mem = ram [addrAm];
+		{
+			byte mem = Read(addrAm);
 			half sum = (half)acc + (half)mem + (status & StatusFlag_Carry) ? 1 : 0;
 			acc = (byte)sum;
 			if(sum > 0xFF)		status |= StatusFlag_Carry;
 			if(!acc)			status |= StatusFlag_Zero;
 			if(acc & (1 << 7))  status |= StatusFlag_Negative;
 			break;
+		}
 		case OP_AND:
-			byte mem = ram [addrAm];
+		{
+			byte mem = Read(addrAm);
 			acc = acc & mem;
 			if(!acc)			status |= StatusFlag_Zero;
 			if(acc & (1 << 7))  status |= StatusFlag_Negative;
 			break;
+		}
 		case OP_BIT:
-			byte mem = ram [addrAm];
+		{
+			byte mem = Read(addrAm);
 			byte test = mem & acc;
 			if(!test) status |= StatusFlag_Zero;
 			if(test & (1 << 6))	status |= StatusFlag_Overflow;
@@ -134,63 +591,73 @@ private:
 			if(test & (1 << 7))	status |= StatusFlag_Negative;
 			else				status &= ~StatusFlag_Negative;
 			break;
+		}
 		case OP_CMP:
-			byte mem = ram[addrAm];
+		{
+			byte mem = Read(addrAm);
 			byte diff = acc - mem;
 			if(acc >= mem) status |= StatusFlag_Carry;
 			if(acc == mem) status |= StatusFlag_Zero;
 			if(diff & (1 << 7))	status |= StatusFlag_Negative;
 			else				status &= ~StatusFlag_Negative;
 			break;
+		}
 		case OP_CPX:
-			byte mem = ram[addrAm];
+		{
+			byte mem = Read(addrAm);
 			byte diff = iX - mem;
 			if(iX >= mem) status |= StatusFlag_Carry;
 			if(iX == mem) status |= StatusFlag_Zero;
 			if(diff & (1 << 7))	status |= StatusFlag_Negative;
 			else				status &= ~StatusFlag_Negative;
 			break;
+		}
 		case OP_CPY:
-			byte mem = ram[addrAm];
+		{
+			byte mem = Read(addrAm);
 			byte diff = iY - mem;
 			if(iY >= mem) status |= StatusFlag_Carry;
 			if(iY == mem) status |= StatusFlag_Zero;
 			if(diff & (1 << 7))	status |= StatusFlag_Negative;
 			else				status &= ~StatusFlag_Negative;
 			break;
+		}
 		case OP_EOR:
-			byte mem = ram[addrAm];
+		{
+			byte mem = Read(addrAm);
 			acc ^= mem;
 			if(!acc) status |= StatusFlag_Zero;
 			if(acc & (1 << 7))	status |= StatusFlag_Negative;
 			else					status &= ~StatusFlag_Negative;
 			break;
+		}
 		case OP_LDA:
-			acc = ram[addrAm];
+			acc = Read(addrAm);
 			if(!acc) status |= StatusFlag_Zero;
 			if(acc & (1 << 7))	status |= StatusFlag_Negative;
 			else					status &= ~StatusFlag_Negative;
 			break;
 		case OP_LDX:
-			iX = ram[addrAm];
+			iX = Read(addrAm);
 			if(!iX) status |= StatusFlag_Zero;
 			if(iX & (1 << 7))	status |= StatusFlag_Negative;
 			else					status &= ~StatusFlag_Negative;
 			break;
 		case OP_LDY:
-			iY = ram[addrAm];
+			iY = Read(addrAm);
 			if(!iY) status |= StatusFlag_Zero;
 			if(iY & (1 << 7))	status |= StatusFlag_Negative;
 			else					status &= ~StatusFlag_Negative;
 			break;
 		case OP_ORA:
-			acc |= ram[addrAm];
+			acc |= Read(addrAm);
 			if(!acc) status |= StatusFlag_Zero;
 			if(acc & (1 << 7))	status |= StatusFlag_Negative;
 			else					status &= ~StatusFlag_Negative;
 			break;
 		case OP_SBC:
-			byte mem = ram [addrAm];
+		{
+			byte mem = Read(addrAm);
 			byte negMem = ~mem + 1; // twos complement
 			half sum = (half)acc + (half)negMem + (status & StatusFlag_Carry) ? 1 : 0;
 			acc = (byte)sum;
@@ -198,31 +665,37 @@ private:
 			if(!acc)			status |= StatusFlag_Zero;
 			if(acc & (1 << 7))  status |= StatusFlag_Negative;
 			break;
+		}
 
 		// one mem read and one mem write, or none
 
 		case OP_ASL:
-			byte val = insti.am == AM_Acc ? acc : ram [addrAm];
+		{
+			byte val = insti.am == AM_Acc ? acc : Read(addrAm);
 			if(val & (1 << 7))	status |= StatusFlag_Carry;
 			else				status &= ~StatusFlag_Carry;
 			val <<= 1;
 			if(!val)			status |= StatusFlag_Zero;
 			if(val & (1 << 7))  status |= StatusFlag_Negative;
 			if(insti.am == AM_Acc)	acc = val;
-			else					ram [addrAm] = val;
+			else					Write(addrAm, val);
 			break;
+		}
 		case OP_LSR:
-			byte val = insti.am == AM_Acc ? acc : ram[addrAm];
+		{
+			byte val = insti.am == AM_Acc ? acc : Read(addrAm);
 			if(val & 1) status |= StatusFlag_Carry;
 			else	status &= ~StatusFlag_Carry;
 			val >> 1;
 			if(!val) status |= StatusFlag_Zero;
 			// negative: Set if bit 7 of the result is set ???
 			if(insti.am == AM_Acc) acc = val;
-			else ram[addrAm] = val;
+			else Write(addrAm, val);
 			break;
+		}
 		case OP_ROL:
-			byte val = insti.am == AM_Acc ? acc : ram[addrAm];
+		{
+			byte val = insti.am == AM_Acc ? acc : Read(addrAm);
 			bool oldBitSeven = (val & (1 << 7)) ? true : false;
 			val << 1;
 			if(status & StatusFlag_Carry) val |= 1;
@@ -230,10 +703,12 @@ private:
 			else status &= ~StatusFlag_Carry;
 			if(!val) status |= StatusFlag_Zero;
 			if(insti.am == AM_Acc) acc = val;
-			else ram[addrAm] = val;
+			else Write(addrAm, val);
 			break;
+		}
 		case OP_ROR:
-			byte val = insti.am == AM_Acc ? acc : ram[addrAm];
+		{
+			byte val = insti.am == AM_Acc ? acc : Read(addrAm);
 			bool oldBitZero = (val & 1) ? true : false;
 			val >> 1;
 			if(status & StatusFlag_Carry) val |= (1 << 7);
@@ -241,27 +716,32 @@ private:
 			else status &= ~StatusFlag_Carry;
 			if(!val) status |= StatusFlag_Zero;
 			if(insti.am == AM_Acc) acc = val;
-			else ram[addrAm] = val;
+			else Write(addrAm, val);
 			break;
+		}
 
 		// one mem read and one mem write
 
 		case OP_DEC:
-			byte mem = ram[addrAm];
+		{
+			byte mem = Read(addrAm);
 			byte result = mem - 1;
 			if(!result) status |= StatusFlag_Zero;
 			if(result & (1 << 7))	status |= StatusFlag_Negative;
 			else					status &= ~StatusFlag_Negative;
-			ram[addrAm] = result;
+			Write(addrAm, result);
 			break;
+		}
 		case OP_INC:
-			byte mem = ram[addrAm];
+		{
+			byte mem = Read(addrAm);
 			byte result = mem + 1;
 			if(!result) status |= StatusFlag_Zero;
 			if(result & (1 << 7))	status |= StatusFlag_Negative;
 			else					status &= ~StatusFlag_Negative;
-			ram[addrAm] = result;
+			Write(addrAm, result);
 			break;
+		}
 
 		// none, break cycles
 
@@ -313,6 +793,7 @@ private:
 			status &= ~StatusFlag_Overflow;
 			break;
 		case OP_DEX:
+		{
 			byte val = iX;
 			byte result = val - 1;
 			if(!result) status |= StatusFlag_Zero;
@@ -320,7 +801,9 @@ private:
 			else					status &= ~StatusFlag_Negative;
 			iX = result;
 			break;
+		}
 		case OP_DEY:
+		{
 			byte val = iY;
 			byte result = val - 1;
 			if(!result) status |= StatusFlag_Zero;
@@ -328,7 +811,9 @@ private:
 			else					status &= ~StatusFlag_Negative;
 			iY = result;
 			break;
+		}
 		case OP_INX:
+		{
 			byte val = iX;
 			byte result = val + 1;
 			if(!result) status |= StatusFlag_Zero;
@@ -336,7 +821,9 @@ private:
 			else					status &= ~StatusFlag_Negative;
 			iX = result;
 			break;
+		}
 		case OP_INY:
+		{
 			byte val = iY;
 			byte result = val + 1;
 			if(!result) status |= StatusFlag_Zero;
@@ -344,6 +831,7 @@ private:
 			else					status &= ~StatusFlag_Negative;
 			iY = result;
 			break;
+		}
 		case OP_NOP:
 			break;
 		case OP_SEC:
@@ -377,11 +865,11 @@ private:
 		// mem write
 		
 		case OP_PHA:
-			ram[sp] = acc;
+			Write(sp, acc);
 			sp--;
 			break;
 		case OP_PHP:
-			ram[sp] = status;
+			Write(sp, status);
 			sp--;
 			break;
 
@@ -389,36 +877,43 @@ private:
 
 		case OP_PLA:
 			sp++;
-			acc = ram[sp];
+			acc = Read(sp);
 			break;
 		case OP_PLP:
 			sp++;
-			status = ram[sp];
+			status = Read(sp);
 			break;
 
 		// two mem reads
 
 		case OP_RTI:
+			// P, PCL, PCH, the reverse of what BRK and NMI push
+			sp++;
+			status = Read(sp);
 			sp++;
-			status = ram[sp];
+			pc = Read(sp);
 			sp++;
-			pc = ram[sp];
+			pc |= Read(sp) << 8;
+			if (pProfiler)
+				pProfiler->OnReturn(sp);
 			break;
 		case OP_RTS:
 			sp++;
-			pc = ram[sp]; // ??? why is this the same cycles as rti?
+			pc = Read(sp); // ??? why is this the same cycles as rti?
+			if (pProfiler)
+				pProfiler->OnReturn(sp);
 			break;
 
 		// one mem write
 
 		case OP_STA:
-			ram[addrAm] = acc;
+			Write(addrAm, acc);
 			break;
 		case OP_STX:
-			ram[addrAm] = iX;
+			Write(addrAm, iX);
 			break;
 		case OP_STY:
-			ram[addrAm] = iY;
+			Write(addrAm, iY);
 			break;
 
 		// free?
@@ -430,25 +925,33 @@ private:
 		// one read. why diff?
 
 		case OP_JSR:
-			ram[sp] = pc;
+			Write(sp, pc);
 			sp--;
 			pc = addrAm;
+			if (pProfiler)
+				pProfiler->OnCall(pc, sp, FrameKind_Call);
 			break;
 		
 		// 3 reads
 		
 		case OP_BRK:
-			ram[sp] = pc;
-			ram[sp - 1] = status;
-			sp -= 2;
+			Write(sp, (byte)(pc >> 8));
+			Write(sp - 1, (byte)pc);
+			Write(sp - 2, status);
+			sp -= 3;
 			status |= StatusFlag_PushSource;
 			pc = pIRQHandler();
+			if (pProfiler)
+				pProfiler->OnCall(pc, sp, FrameKind_Brk);
 			break;
 
 		default:
 			assert(false);
 			break;
 		}
+
+		if (cCycle >= cCycleSync)
+			Sync();
 	}
 
 	half addrFromAm(AddresingMode am)
@@ -463,16 +966,16 @@ private:
 			return pc + 1;
 			break;
 		case AM_ZP:
-			return ram[pc + 1]; // one read
+			return Read(pc + 1); // one read
 			break;
 		case AM_ZPX:
-			return (ram[pc + 1] + iX) % 0x100; // one read and an alu op
+			return (Read(pc + 1) + iX) % 0x100; // one read and an alu op
 			break;
 		case AM_ZPY:
-			return (ram[pc + 1] + iY) % 0x100; // one read and an alu op
+			return (Read(pc + 1) + iY) % 0x100; // one read and an alu op
 			break;
 		case AM_Rel:
-			return pc + ((sbyte)ram[pc + 1]) + 2; // one read and alu op (only if jmp) . why pgx matter?
+			return pc + ((sbyte)Read(pc + 1)) + 2; // one read and alu op (only if jmp) . why pgx matter?
 			break;
 		case AM_Abs:
 			return halfAt(pc + 1); // two reads
@@ -487,137 +990,13 @@ private:
 			return halfAt(halfAt(pc + 1)); // four reads
 			break;
 		case AM_IndX:
-			return (ram[pc + 1] + iX) % 0x100; //one read and alu op
+			return (Read(pc + 1) + iX) % 0x100; //one read and alu op
 			break;
 		case AM_IndY:
-			return halfAt(ram[pc + 1]) + iY; // three reads and alu op (why less expensive than indx?) why page cross matter
+			return halfAt(Read(pc + 1)) + iY; // three reads and alu op (why less expensive than indx?) why page cross matter
 			break;
 		default:
 			break;
 		}
 	}
 };
-
-// http://www.obelisk.me.uk/6502/reference.html
-
-enum OpCode : byte
-{
-	OP_ADC, // Add with Carry
-	OP_AND, // Logical AND
-	OP_ASL, // Arithmetic Shift Left
-	OP_BCC, // Branch if Carry Clear
-	OP_BCS, // Branch if Carry Set
-	OP_BEQ, // Branch if Equal
-	OP_BIT, // Bit Test
-	OP_BMI, // Branch if Minus
-	OP_BNE, // Branch if Not Equal
-	OP_BPL, // Branch if Positive
-	OP_BRK, // Force Interrupt
-	OP_BVC, // Branch if Overflow Clear
-	OP_BVS, // Branch if Overflow Set
-	OP_CLC, // Clear Carry Flag
-	OP_CLD, // Clear Decimal Mode
-	OP_CLI, // Clear Interrupt Disable
-	OP_CLV, // Clear Overflow Flag
-	OP_CMP, // Compare
-	OP_CPX, // Compare X Register
-	OP_CPY, // Compare Y Register
-	OP_DEC, // Decrement Memory
-	OP_DEX, // Decrement X Register
-	OP_DEY, // Decrement Y Register
-	OP_EOR, // Exclusive OR
-	OP_INC, // Increment Memory
-	OP_INX, // Increment X Register
-	OP_INY, // Increment Y Register
-	OP_JMP, // Jump
-	OP_JSR, // Jump to Subroutine
-	OP_LDA, // Load Accumulator
-	OP_LDX, // Load X Register
-	OP_LDY, // Load Y Register
-	OP_LSR, // Logical Shift Right
-	OP_NOP, // NOP
-	OP_ORA, // Logical Inclusive OR
-	OP_PHA, // Push Accumulator
-	OP_PHP, // Push Processor Status
-	OP_PLA, // Pull Accumulator
-	OP_PLP, // Pull Processor Status
-	OP_ROL, // Rotate Left
-	OP_ROR, // Rotate Right
-	OP_RTI, // Return from Interrupt
-	OP_RTS, // Return from Subroutine
-	OP_SBC, // Subtract with Carry
-	OP_SEC, // Set Carry Flag
-	OP_SED, // Set Decimal Flag
-	OP_SEI, // Set Interrupt Disable
-	OP_STA, // Store Accumulator
-	OP_STX, // Store X Register
-	OP_STY, // Store Y Register
-	OP_TAX, // Transfer Accumulator to X
-	OP_TAY, // Transfer Accumulator to Y
-	OP_TSX, // Transfer Stack Pointer to X
-	OP_TXA, // Transfer X to Accumulator
-	OP_TXS, // Transfer X to Stack Pointer
-	OP_TYA, // Transfer Y to Accumulator
-
-	OP_INVALID,
-};
-
-// http://www.obelisk.me.uk/6502/addressing.html
-
-enum AddresingMode : byte
-{
-	AM_Imp,		// Implicit
-	AM_Acc,		// Accumulator
-	AM_Imm,		// Immediate
-	AM_ZP,		// Zero Page
-	AM_ZPX,		// Zero Page, X
-	AM_ZPY,		// Zero Page, Y
-	AM_Rel,		// Relative
-	AM_Abs,		// Absolute
-	AM_AbsX,	// Absolute, X
-	AM_AbsY,	// Absolute, Y
-	AM_Ind,		// Indirect
-	AM_IndX,	// Indirect, X
-	AM_IndY		// Indirect, Y
-};
-
-struct IntructionInfo
-{
-	OpCode op;
-	AddresingMode am;
-};
-
-#define INST_INVALID_______ {OP_INVALID, AM_Imp}
-
-// lookup table that converts from byte to opcode and addressing mode
-
-const IntructionInfo aryInsti[256] =
-{
-	// http://www.llx.com/~nparker/a2/opcodes.html
-	// http://www.obelisk.me.uk/6502/reference.html
-	// https://en.wikipedia.org/wiki/MOS_Technology_6502#Assembly_language_instructions
-	/*  | x0                 | x1                 | x2                 | x3                 | x4                 | x5                 | x6                 | x7                 | x8                 | x9                 | xA                 | xB                 | xC                 | xD                 | xE                 | xF                 |*/
-	/*0x*/{ OP_BRK, AM_Imp  }, { OP_ORA, AM_IndX }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_ZP   }, { OP_ASL, AM_ZP   }, INST_INVALID_______, { OP_PHP, AM_Imp  }, { OP_ORA, AM_Imm  }, { OP_ASL, AM_Acc  }, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_Abs  }, { OP_ASL, AM_Abs  }, INST_INVALID_______,
-	/*1x*/{ OP_BPL, AM_Rel  }, { OP_ORA, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_ZPX  }, { OP_ASL, AM_ZPX  }, INST_INVALID_______, { OP_CLC, AM_Imp  }, { OP_ORA, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ORA, AM_AbsX }, { OP_ASL, AM_AbsX }, INST_INVALID_______,
-	/*2x*/{ OP_JSR, AM_Abs  }, { OP_AND, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_BIT, AM_ZP   }, { OP_AND, AM_ZP   }, { OP_ROL, AM_ZP   }, INST_INVALID_______, { OP_PLP, AM_Imp  }, { OP_AND, AM_Imm  }, { OP_ROL, AM_Acc  }, INST_INVALID_______, { OP_BIT, AM_Abs  }, { OP_AND, AM_Abs  }, { OP_ROL, AM_Abs  }, INST_INVALID_______,
-	/*3x*/{ OP_BMI, AM_Rel  }, { OP_AND, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_AND, AM_ZPX  }, { OP_ROL, AM_ZPX  }, INST_INVALID_______, { OP_SEC, AM_Imp  }, { OP_AND, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_AND, AM_AbsX }, { OP_ROL, AM_AbsX }, INST_INVALID_______,
-	/*4x*/{ OP_RTI, AM_Imp  }, { OP_EOR, AM_IndX }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_EOR, AM_ZP   }, { OP_LSR, AM_ZP   }, INST_INVALID_______, { OP_PHA, AM_Imp  }, { OP_EOR, AM_Imm  }, { OP_LSR, AM_Acc  }, INST_INVALID_______, { OP_JMP, AM_Abs  }, { OP_EOR, AM_Abs  }, { OP_LSR, AM_Abs  }, INST_INVALID_______,
-	/*5x*/{ OP_BVC, AM_Rel  }, { OP_EOR, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_EOR, AM_ZPX  }, { OP_LSR, AM_ZPX  }, INST_INVALID_______, { OP_CLI, AM_Imp  }, { OP_EOR, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_EOR, AM_AbsX }, { OP_LSR, AM_AbsX }, INST_INVALID_______,
-	/*6x*/{ OP_RTS, AM_Imp  }, { OP_ADC, AM_IndX }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ADC, AM_ZP   }, { OP_ROR, AM_ZP   }, INST_INVALID_______, { OP_PLA, AM_Imp  }, { OP_ADC, AM_Imm  }, { OP_ROR, AM_Acc  }, INST_INVALID_______, { OP_JMP, AM_Ind  }, { OP_ADC, AM_Abs  }, { OP_ROR, AM_Abs  }, INST_INVALID_______,
-	/*7x*/{ OP_BVS, AM_Rel  }, { OP_ADC, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ADC, AM_ZPX  }, { OP_ROR, AM_ZPX  }, INST_INVALID_______, { OP_SEI, AM_Imp  }, { OP_ADC, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_ADC, AM_AbsX }, { OP_ROR, AM_AbsX }, INST_INVALID_______,
-	/*8x*/INST_INVALID_______, { OP_STA, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_STY, AM_ZP   }, { OP_STA, AM_ZP   }, { OP_STX, AM_ZP   }, INST_INVALID_______, { OP_DEY, AM_Imp  }, INST_INVALID_______, { OP_TXA, AM_Imp  }, INST_INVALID_______, { OP_STY, AM_Abs  }, { OP_STA, AM_Abs  }, { OP_STX, AM_Abs  }, INST_INVALID_______,
-	/*9x*/{ OP_BCC, AM_Rel  }, { OP_STY, AM_IndY }, INST_INVALID_______, INST_INVALID_______, { OP_STY, AM_ZPX  }, { OP_STA, AM_ZPX  }, { OP_STX, AM_ZPY  }, INST_INVALID_______, { OP_TYA, AM_Imp  }, { OP_STA, AM_AbsY }, { OP_TXS, AM_Imp  }, INST_INVALID_______, INST_INVALID_______, { OP_STA, AM_AbsX }, INST_INVALID_______, INST_INVALID_______,
-	/*Ax*/{ OP_LDY, AM_Imm  }, { OP_LDA, AM_IndX }, { OP_LDX, AM_Imm  }, INST_INVALID_______, { OP_LDY, AM_ZP   }, { OP_LDA, AM_ZP   }, { OP_LDX, AM_ZP   }, INST_INVALID_______, { OP_TAY, AM_Imp  }, { OP_LDA, AM_Imm  }, { OP_TAX, AM_Imp  }, INST_INVALID_______, { OP_LDY, AM_Abs  }, { OP_LDA, AM_Abs  }, { OP_LDX, AM_Abs  }, INST_INVALID_______,
-	/*Bx*/{ OP_BCS, AM_Rel  }, { OP_LDA, AM_IndY }, INST_INVALID_______, INST_INVALID_______, { OP_LDY, AM_ZPX  }, { OP_LDA, AM_ZPX  }, { OP_LDX, AM_ZPY  }, INST_INVALID_______, { OP_CLV, AM_Imp  }, { OP_LDA, AM_AbsY }, { OP_TSX, AM_Imp  }, INST_INVALID_______, { OP_LDY, AM_AbsX }, { OP_LDA, AM_AbsX }, { OP_LDX, AM_AbsY }, INST_INVALID_______,
-	/*Cx*/{ OP_CPY, AM_Imm  }, { OP_CMP, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_CPY, AM_ZP   }, { OP_CMP, AM_ZP   }, { OP_DEC, AM_ZP   }, INST_INVALID_______, { OP_INY, AM_Imp  }, { OP_CMP, AM_Imm  }, { OP_DEX, AM_Imp  }, INST_INVALID_______, { OP_CPY, AM_Abs  }, { OP_CMP, AM_Abs  }, { OP_DEC, AM_Abs  }, INST_INVALID_______,
-	/*Dx*/{ OP_BNE, AM_Rel  }, { OP_CMP, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_CMP, AM_ZPX  }, { OP_DEC, AM_ZPX  }, INST_INVALID_______, { OP_CLD, AM_Imp  }, { OP_CMP, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_CMP, AM_AbsX }, { OP_DEC, AM_AbsX }, INST_INVALID_______,
-	/*Ex*/{ OP_CPX, AM_Imm  }, { OP_SBC, AM_IndX }, INST_INVALID_______, INST_INVALID_______, { OP_CPX, AM_ZP   }, { OP_SBC, AM_ZP   }, { OP_INC, AM_ZP   }, INST_INVALID_______, { OP_INX, AM_Imp  }, { OP_SBC, AM_Imm  }, { OP_NOP, AM_Imp  }, INST_INVALID_______, { OP_CPX, AM_Abs  }, { OP_SBC, AM_Abs  }, { OP_INC, AM_Abs  }, INST_INVALID_______,
-	/*Fx*/{ OP_BEQ, AM_Rel  }, { OP_SBC, AM_IndY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_SBC, AM_ZPX  }, { OP_INC, AM_ZPX  }, INST_INVALID_______, { OP_SED, AM_Imp  }, { OP_SBC, AM_AbsY }, INST_INVALID_______, INST_INVALID_______, INST_INVALID_______, { OP_SBC, AM_AbsX }, { OP_INC, AM_AbsX }, INST_INVALID_______,
-};
-
-#undef INST_INVALID
-
-const IntructionInfo InstiFromByte(byte instruction)
-{
-	return aryInsti[instruction];
-}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+#include "Types.h"
+#include <cstdlib>
+#include <cassert>
+
+// per thread allocator for machine state and memory pages.
+// blocks are carved out of large chunks and recycled through a free list per size,
+// so the state of many machines packs densely and never takes the global heap lock.
+//
+// a block must be freed on the thread that allocated it, and every allocation
+// of a given size must ask for the same alignment.
+// chunks are never returned to the system
+
+class Arena
+{
+public:
+	void* PvAlloc(u32 cb, u32 cbAlign)
+	{
+		assert(cb > 0 && cb <= CB_BLOCK_MAX);
+		assert(cbAlign && !(cbAlign & (cbAlign - 1)) && cbAlign <= CB_ALIGN_MAX);
+
+		int iSize = ISizeFromCb(cb);
+		FreeBlock* pBlock = aryPFree[iSize];
+		u32 cbBlock = (iSize + 1) * CB_GRAIN;
+		cbLive += cbBlock;
+
+		if (pBlock)
+		{
+			aryPFree[iSize] = pBlock->pNext;
+			return pBlock;
+		}
+
+		u32 cbPad = (cbAlign - ((size_t)pbChunk & (cbAlign - 1))) & (cbAlign - 1);
+		if (!pbChunk || cbChunkLeft < cbPad + cbBlock)
+		{
+			pbChunk = (byte*)malloc(CB_CHUNK);
+			assert(pbChunk);
+			cbChunkLeft = CB_CHUNK;
+			cbReserved += CB_CHUNK;
+
+			// malloc only promises 8 byte alignment
+			cbPad = (cbAlign - ((size_t)pbChunk & (cbAlign - 1))) & (cbAlign - 1);
+		}
+
+		void* pv = pbChunk + cbPad;
+		pbChunk += cbPad + cbBlock;
+		cbChunkLeft -= cbPad + cbBlock;
+		return pv;
+	}
+
+	void Free(void* pv, u32 cb)
+	{
+		if (!pv)
+			return;
+
+		int iSize = ISizeFromCb(cb);
+		cbLive -= (iSize + 1) * CB_GRAIN;
+
+		FreeBlock* pBlock = (FreeBlock*)pv;
+		pBlock->pNext = aryPFree[iSize];
+		aryPFree[iSize] = pBlock;
+	}
+
+	// bytes in blocks that have not been freed
+	u64 CbLive() const
+	{
+		return cbLive;
+	}
+
+	// bytes taken from the system
+	u64 CbReserved() const
+	{
+		return cbReserved;
+	}
+
+private:
+	static const u32 CB_GRAIN = 8;				// block sizes are rounded up to this
+	static const u32 CB_BLOCK_MAX = 16 * KB;
+	static const u32 CB_ALIGN_MAX = 64;			// a cache line
+	static const u32 CB_CHUNK = 1024 * KB;
+
+	struct FreeBlock
+	{
+		FreeBlock* pNext;
+	};
+
+	static int ISizeFromCb(u32 cb)
+	{
+		return (cb - 1) / CB_GRAIN;
+	}
+
+	// free list for each block size
+	FreeBlock* aryPFree[CB_BLOCK_MAX / CB_GRAIN];
+
+	// unused tail of the current chunk
+	byte* pbChunk;
+	u32 cbChunkLeft;
+
+	u64 cbLive;
+	u64 cbReserved;
+};
+
+// the arena for the calling thread.
+// thread local storage can not have a constructor, everything starts zeroed
+
+inline Arena& ArenaThread()
+{
+	static __declspec(thread) Arena s_arena;
+	return s_arena;
+}
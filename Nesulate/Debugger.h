@@ -0,0 +1,740 @@
+#pragma once
+#include "Types.h"
+#include "6502.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET Socket;
+#define SOCKET_NONE INVALID_SOCKET
+#define CloseSocket closesocket
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int Socket;
+#define SOCKET_NONE (-1)
+#define CloseSocket close
+#endif
+
+// debugger for a running CPU_6502, driven over a local socket with the gdb remote protocol.
+// see https://sourceware.org/gdb/onlinedocs/gdb/Remote-Protocol.html
+//
+// breakpoints and watchpoints are kept as a bit per address, and a Trap flag per page
+// for the cpu to test (see Trap in 6502.h). the cpu only calls us on flagged pages, and
+// tests the flags along with the ones it already needs for io, so a running machine with
+// nothing set pays nothing for the debugger.
+//
+// when the machine stops, OnExec serves the client on the emulation thread until it
+// continues or steps, so the host loop never has to know a debugger is attached.
+// the host calls Poll every so often (once a frame is plenty) to accept a client and
+// notice a ^C interrupt.
+//
+// registers ('g' and 'G') are 8 bytes: A X Y P, then SP and PC as 16 bit little endian,
+// described to gdb by the target description from qXfer:features:read.
+// range stepping (vCont;r, which gdb uses for "next") steps over a JSR in the range
+// instead of into it: it runs until the JSR's return address is reached with the stack
+// back at the depth it had before the JSR
+
+class Debugger : public TrapHandler
+{
+public:
+	Debugger()
+	: pCpu(nullptr)
+	, addrStepOver(-1)
+	, spStepOver(0)
+	, fRange(false)
+	, addrRangeMic(0)
+	, addrRangeMac(0)
+	, fConnecting(false)
+	, sockListen(SOCKET_NONE)
+	, sockClient(SOCKET_NONE)
+	{
+		const byte* aryPageIo = CPU_6502::AryTrapNone();
+		for (int iPage = 0; iPage < 64 * KB / PAGE_SIZE; ++iPage)
+		{
+			aryPageTrap[iPage] = aryPageIo[iPage];
+			aryPageTrapStop[iPage] = aryPageIo[iPage] | Trap_Exec;
+		}
+		memset(aryBits, 0, sizeof(aryBits));
+		szStop[0] = '\0';
+	}
+
+	~Debugger()
+	{
+		Detach();
+		CloseClient();
+		if (sockListen != SOCKET_NONE)
+			CloseSocket(sockListen);
+	}
+
+	void Attach(CPU_6502* pCpuNew)
+	{
+		Detach();
+		pCpu = pCpuNew;
+		pCpu->pTrapHandler = this;
+		pCpu->aryPageTrap = aryPageTrap;
+	}
+
+	void Detach()
+	{
+		if (!pCpu)
+			return;
+
+		pCpu->aryPageTrap = CPU_6502::AryTrapNone();
+		pCpu->pTrapHandler = nullptr;
+		pCpu = nullptr;
+	}
+
+	// listen for a client on 127.0.0.1:port
+
+	bool FListen(u16 port)
+	{
+#ifdef _WIN32
+		WSADATA wsadata;
+		if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+			return false;
+#endif
+
+		sockListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (sockListen == SOCKET_NONE)
+			return false;
+
+		int fReuse = 1;
+		setsockopt(sockListen, SOL_SOCKET, SO_REUSEADDR, (const char*)&fReuse, sizeof(fReuse));
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+
+		if (bind(sockListen, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(sockListen, 1) != 0)
+		{
+			CloseSocket(sockListen);
+			sockListen = SOCKET_NONE;
+			return false;
+		}
+
+		return true;
+	}
+
+	// accept a client, or notice an interrupt from one. never blocks.
+	// either way the machine stops before its next instruction
+
+	void Poll()
+	{
+		if (!pCpu)
+			return;
+
+		if (sockClient == SOCKET_NONE)
+		{
+			if (sockListen == SOCKET_NONE || !FReadable(sockListen))
+				return;
+
+			// a new client expects us stopped, but asks why itself
+			sockClient = accept(sockListen, nullptr, nullptr);
+			if (sockClient != SOCKET_NONE)
+			{
+				fConnecting = true;
+				StopSoon("S05");
+			}
+			return;
+		}
+
+		while (FReadable(sockClient))
+		{
+			int ch = ChRecv();
+			if (ch < 0)
+			{
+				CloseClient();
+				return;
+			}
+
+			if (ch == 0x03)
+				StopSoon("S02");
+		}
+	}
+
+	// set or clear a breakpoint (Trap_Exec) or watchpoint (Trap_Read, Trap_Write) at addr
+
+	void SetTrap(half addr, Trap trap, bool fSet)
+	{
+		byte* pb = &aryBits[IKind(trap)][addr >> 3];
+		if (fSet)
+			*pb |= 1 << (addr & 7);
+		else
+			*pb &= ~(1 << (addr & 7));
+
+		UpdatePage(addr >> 8);
+	}
+
+	// TrapHandler
+
+	virtual void OnExec(half pc)
+	{
+		bool fStepping = pCpu->aryPageTrap == aryPageTrapStop;
+		bool fBreak = FTrap(pc, Trap_Exec);
+		bool fStepOverDone = addrStepOver >= 0 && pc == addrStepOver && pCpu->sp >= spStepOver;
+		if (!fStepping && !fBreak && !fStepOverDone)
+			return;
+
+		if (fStepOverDone)
+			ClearStepOver();
+
+		// keep range stepping while in the range, unless something else stopped us
+		if (fRange && !fBreak && !szStop[0] && pc >= addrRangeMic && pc < addrRangeMac)
+		{
+			Step();
+			return;
+		}
+
+		fRange = false;
+		ClearStepOver();
+		pCpu->aryPageTrap = aryPageTrap;
+
+		if (sockClient == SOCKET_NONE)
+		{
+			szStop[0] = '\0';
+			return;
+		}
+
+		if (!fConnecting)
+			SendPacket(szStop[0] ? szStop : "S05");
+		szStop[0] = '\0';
+		fConnecting = false;
+
+		Serve();
+	}
+
+	virtual void OnAccess(half addr, Trap trap)
+	{
+		if (!FTrap(addr, trap))
+			return;
+
+		// stop once the instruction doing the access is done
+
+		char szReason[32];
+		SNPRINTF(szReason, sizeof(szReason), "T05%s:%04x;", trap == Trap_Write ? "watch" : "rwatch", addr);
+		StopSoon(szReason);
+	}
+
+private:
+	CPU_6502* pCpu;
+
+	// what the cpu tests, see Trap
+	byte aryPageTrap[64 * KB / PAGE_SIZE];
+
+	// the same with Trap_Exec on every page, swapped in to stop before the next instruction
+	byte aryPageTrapStop[64 * KB / PAGE_SIZE];
+
+	// a bit per address for each of Trap_Exec, Trap_Read, Trap_Write
+	byte aryBits[3][64 * KB / 8];
+
+	// temporary breakpoint for stepping over a JSR, -1 if none.
+	// only taken once sp is back up to spStepOver, so a recursive call does not stop early
+	int addrStepOver;
+	half spStepOver;
+
+	// range stepping, keep stepping while pc is in [addrRangeMic, addrRangeMac)
+	bool fRange;
+	half addrRangeMic;
+	half addrRangeMac;
+
+	// stop reply to send when we stop
+	char szStop[32];
+	bool fConnecting;
+
+	Socket sockListen;
+	Socket sockClient;
+
+	static int IKind(Trap trap)
+	{
+		return trap == Trap_Exec ? 0 : trap == Trap_Read ? 1 : 2;
+	}
+
+	bool FTrap(half addr, Trap trap) const
+	{
+		return (aryBits[IKind(trap)][addr >> 3] & (1 << (addr & 7))) != 0;
+	}
+
+	void UpdatePage(int iPage)
+	{
+		static const Trap aryTrap[3] = { Trap_Exec, Trap_Read, Trap_Write };
+
+		byte flags = 0;
+		for (int iKind = 0; iKind < 3; ++iKind)
+		{
+			const byte* pb = &aryBits[iKind][iPage * (PAGE_SIZE / 8)];
+			for (int ib = 0; ib < PAGE_SIZE / 8; ++ib)
+			{
+				if (pb[ib])
+				{
+					flags |= aryTrap[iKind];
+					break;
+				}
+			}
+		}
+
+		if (addrStepOver >= 0 && (addrStepOver >> 8) == iPage)
+			flags |= Trap_Exec;
+
+		flags |= CPU_6502::AryTrapNone()[iPage];
+
+		aryPageTrap[iPage] = flags;
+		aryPageTrapStop[iPage] = flags | Trap_Exec;
+	}
+
+	void StopSoon(const char* szReason)
+	{
+		if (!szStop[0])
+			CopySz(szStop, szReason, sizeof(szStop));
+
+		if (pCpu)
+			pCpu->aryPageTrap = aryPageTrapStop;
+	}
+
+	// run the instruction at pc and stop. a JSR runs until it returns
+	void Step()
+	{
+		if (InstiFromByte(pCpu->Peek(pCpu->pc)).op == OP_JSR)
+		{
+			addrStepOver = (half)(pCpu->pc + 3);
+			spStepOver = pCpu->sp;
+			UpdatePage(addrStepOver >> 8);
+			pCpu->aryPageTrap = aryPageTrap;
+		}
+		else
+		{
+			pCpu->aryPageTrap = aryPageTrapStop;
+		}
+	}
+
+	void ClearStepOver()
+	{
+		if (addrStepOver < 0)
+			return;
+
+		int iPage = addrStepOver >> 8;
+		addrStepOver = -1;
+		UpdatePage(iPage);
+	}
+
+	void ClearTraps()
+	{
+		memset(aryBits, 0, sizeof(aryBits));
+		addrStepOver = -1;
+		fRange = false;
+		for (int iPage = 0; iPage < 64 * KB / PAGE_SIZE; ++iPage)
+		{
+			UpdatePage(iPage);
+		}
+	}
+
+	// PROTOCOL
+
+	// handle packets until the client continues, steps, or goes away
+
+	void Serve()
+	{
+		char szPacket[1024];
+		char szReply[1024];
+
+		for (;;)
+		{
+			if (!FRecvPacket(szPacket, sizeof(szPacket)))
+			{
+				CloseClient();
+				ClearTraps();
+				return;
+			}
+
+			szReply[0] = '\0';
+			const char* pch = szPacket + 1;
+
+			switch (szPacket[0])
+			{
+			case '?':
+				CopySz(szReply, "S05", sizeof(szReply));
+				break;
+
+			case 'g':
+				{
+					byte aryReg[8] =
+					{
+						pCpu->acc, pCpu->iX, pCpu->iY, pCpu->status,
+						(byte)pCpu->sp, (byte)(pCpu->sp >> 8),
+						(byte)pCpu->pc, (byte)(pCpu->pc >> 8),
+					};
+					HexFromBytes(aryReg, 8, szReply);
+				}
+				break;
+
+			case 'G':
+				{
+					byte aryReg[8];
+					if (strlen(pch) != 16 || !FBytesFromHex(pch, 8, aryReg))
+					{
+						CopySz(szReply, "E01", sizeof(szReply));
+						break;
+					}
+					pCpu->acc = aryReg[0];
+					pCpu->iX = aryReg[1];
+					pCpu->iY = aryReg[2];
+					pCpu->status = aryReg[3];
+					pCpu->sp = aryReg[4] | (aryReg[5] << 8);
+					pCpu->pc = aryReg[6] | (aryReg[7] << 8);
+					CopySz(szReply, "OK", sizeof(szReply));
+				}
+				break;
+
+			case 'm':
+				{
+					// m addr,length
+					char* pchEnd;
+					u32 addr = strtoul(pch, &pchEnd, 16);
+					u32 cb = (*pchEnd == ',') ? strtoul(pchEnd + 1, nullptr, 16) : 0;
+					if (cb > (sizeof(szReply) - 1) / 2)
+						cb = (sizeof(szReply) - 1) / 2;
+
+					for (u32 ib = 0; ib < cb; ++ib)
+					{
+						byte val = pCpu->Peek((half)(addr + ib));
+						HexFromBytes(&val, 1, szReply + 2 * ib);
+					}
+				}
+				break;
+
+			case 'M':
+				{
+					// M addr,length:XX...
+					char* pchEnd;
+					u32 addr = strtoul(pch, &pchEnd, 16);
+					u32 cb = (*pchEnd == ',') ? strtoul(pchEnd + 1, &pchEnd, 16) : 0;
+					if (*pchEnd != ':' || strlen(pchEnd + 1) != 2 * cb)
+					{
+						CopySz(szReply, "E01", sizeof(szReply));
+						break;
+					}
+
+					// the length check above keeps cb under half the packet. decode it all
+					// first, so a bad digit writes nothing
+					byte aryVal[sizeof(szPacket) / 2];
+					if (!FBytesFromHex(pchEnd + 1, cb, aryVal))
+					{
+						CopySz(szReply, "E01", sizeof(szReply));
+						break;
+					}
+
+					for (u32 ib = 0; ib < cb; ++ib)
+					{
+						pCpu->Poke((half)(addr + ib), aryVal[ib]);
+					}
+					CopySz(szReply, "OK", sizeof(szReply));
+				}
+				break;
+
+			case 'c':
+				return;
+
+			case 's':
+				pCpu->aryPageTrap = aryPageTrapStop;
+				return;
+
+			case 'v':
+				if (!strcmp(pch, "Cont?"))
+				{
+					CopySz(szReply, "vCont;c;C;s;S;r", sizeof(szReply));
+				}
+				else if (!strncmp(pch, "Cont;", 5))
+				{
+					// only the first action matters, there is one thread
+					pch += 5;
+					switch (*pch)
+					{
+					case 'c':
+					case 'C':
+						return;
+					case 's':
+					case 'S':
+						pCpu->aryPageTrap = aryPageTrapStop;
+						return;
+					case 'r':
+						{
+							// r start,end
+							char* pchEnd;
+							addrRangeMic = (half)strtoul(pch + 1, &pchEnd, 16);
+							addrRangeMac = (*pchEnd == ',') ? (half)strtoul(pchEnd + 1, nullptr, 16) : addrRangeMic;
+							fRange = true;
+							Step();
+						}
+						return;
+					default:
+						CopySz(szReply, "E01", sizeof(szReply));
+						break;
+					}
+				}
+				break;
+
+			case 'Z':
+			case 'z':
+				{
+					// Z type,addr,kind
+					char* pchEnd;
+					u32 type = strtoul(pch, &pchEnd, 16);
+					u32 addr = (*pchEnd == ',') ? strtoul(pchEnd + 1, nullptr, 16) : 0;
+					bool fSet = szPacket[0] == 'Z';
+
+					switch (type)
+					{
+					case 0: // software breakpoint
+					case 1: // hardware breakpoint
+						SetTrap((half)addr, Trap_Exec, fSet);
+						break;
+					case 2: // write watchpoint
+						SetTrap((half)addr, Trap_Write, fSet);
+						break;
+					case 3: // read watchpoint
+						SetTrap((half)addr, Trap_Read, fSet);
+						break;
+					case 4: // access watchpoint
+						SetTrap((half)addr, Trap_Read, fSet);
+						SetTrap((half)addr, Trap_Write, fSet);
+						break;
+					default:
+						break;
+					}
+
+					if (type <= 4)
+						CopySz(szReply, "OK", sizeof(szReply));
+				}
+				break;
+
+			case 'H':
+				CopySz(szReply, "OK", sizeof(szReply));
+				break;
+
+			case 'q':
+				if (!strncmp(pch, "Supported", 9))
+					CopySz(szReply, "PacketSize=3ff;qXfer:features:read+;vContSupported+", sizeof(szReply));
+				else if (!strcmp(pch, "Attached"))
+					CopySz(szReply, "1", sizeof(szReply));
+				else if (!strncmp(pch, "Xfer:features:read:target.xml:", 30))
+					XferTargetXml(pch + 30, szReply, sizeof(szReply));
+				break;
+
+			case 'D':
+				// detach, and let the machine run free
+				SendPacket("OK");
+				CloseClient();
+				ClearTraps();
+				return;
+
+			case 'k':
+				CloseClient();
+				ClearTraps();
+				return;
+
+			default:
+				// unsupported, empty reply
+				break;
+			}
+
+			SendPacket(szReply);
+		}
+	}
+
+	// read one $packet#xx into szPacket (without the framing), acking it
+
+	bool FRecvPacket(char* szPacket, int cchMax)
+	{
+		for (;;)
+		{
+			int ch;
+			do
+			{
+				// skip acks, and interrupts we are already stopped for
+				ch = ChRecv();
+				if (ch < 0)
+					return false;
+			}
+			while (ch != '$');
+
+			int cch = 0;
+			byte checksum = 0;
+			for (;;)
+			{
+				ch = ChRecv();
+				if (ch < 0)
+					return false;
+				if (ch == '#')
+					break;
+
+				checksum += (byte)ch;
+				if (cch < cchMax - 1)
+					szPacket[cch++] = (char)ch;
+			}
+			szPacket[cch] = '\0';
+
+			char aryChChecksum[2];
+			for (int i = 0; i < 2; ++i)
+			{
+				ch = ChRecv();
+				if (ch < 0)
+					return false;
+				aryChChecksum[i] = (char)ch;
+			}
+
+			byte checksumSent;
+			if (FBytesFromHex(aryChChecksum, 1, &checksumSent) && checksumSent == checksum)
+			{
+				SendRaw("+", 1);
+				return true;
+			}
+
+			SendRaw("-", 1);
+		}
+	}
+
+	void SendPacket(const char* szData)
+	{
+		char szPacket[1100];
+
+		byte checksum = 0;
+		for (const char* pch = szData; *pch; ++pch)
+		{
+			checksum += (byte)*pch;
+		}
+
+		int cch = SNPRINTF(szPacket, sizeof(szPacket), "$%s#%02x", szData, checksum);
+		SendRaw(szPacket, cch);
+	}
+
+	// reply to qXfer:features:read:target.xml:offset,length with that part of the
+	// target description, 'm' if there is more after it, 'l' if not
+
+	static void XferTargetXml(const char* pch, char* szReply, int cchReply)
+	{
+		static const char s_szTargetXml[] =
+			"<?xml version=\"1.0\"?>"
+			"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+			"<target version=\"1.0\">"
+			"<feature name=\"org.nesulate.6502\">"
+			"<reg name=\"a\" bitsize=\"8\" type=\"uint8\"/>"
+			"<reg name=\"x\" bitsize=\"8\" type=\"uint8\"/>"
+			"<reg name=\"y\" bitsize=\"8\" type=\"uint8\"/>"
+			"<reg name=\"p\" bitsize=\"8\" type=\"uint8\"/>"
+			"<reg name=\"sp\" bitsize=\"16\" type=\"data_ptr\"/>"
+			"<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+			"</feature>"
+			"</target>";
+		static const u32 cchTargetXml = sizeof(s_szTargetXml) - 1;
+
+		char* pchEnd;
+		u32 ich = strtoul(pch, &pchEnd, 16);
+		u32 cch = (*pchEnd == ',') ? strtoul(pchEnd + 1, nullptr, 16) : 0;
+
+		if (ich > cchTargetXml)
+			ich = cchTargetXml;
+		if (cch > cchTargetXml - ich)
+			cch = cchTargetXml - ich;
+		if ((int)cch > cchReply - 2)
+			cch = cchReply - 2;
+
+		// the description has none of the characters the binary reply would need to escape
+		szReply[0] = (ich + cch < cchTargetXml) ? 'm' : 'l';
+		memcpy(szReply + 1, s_szTargetXml + ich, cch);
+		szReply[cch + 1] = '\0';
+	}
+
+	static void CopySz(char* szDst, const char* szSrc, int cchDst)
+	{
+		int ich = 0;
+		for (; ich < cchDst - 1 && szSrc[ich]; ++ich)
+		{
+			szDst[ich] = szSrc[ich];
+		}
+		szDst[ich] = '\0';
+	}
+
+	// SOCKETS
+
+	void SendRaw(const char* pch, int cch)
+	{
+		if (sockClient != SOCKET_NONE)
+			send(sockClient, pch, cch, 0);
+	}
+
+	// next byte from the client, blocking. -1 if the connection is gone
+	int ChRecv()
+	{
+		if (sockClient == SOCKET_NONE)
+			return -1;
+
+		char ch;
+		if (recv(sockClient, &ch, 1, 0) != 1)
+			return -1;
+
+		return (byte)ch;
+	}
+
+	static bool FReadable(Socket sock)
+	{
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+
+		timeval tv = {};
+		return select((int)sock + 1, &fds, nullptr, nullptr, &tv) > 0;
+	}
+
+	void CloseClient()
+	{
+		if (sockClient == SOCKET_NONE)
+			return;
+
+		CloseSocket(sockClient);
+		sockClient = SOCKET_NONE;
+	}
+
+	// HEX
+
+	static void HexFromBytes(const byte* pb, int cb, char* sz)
+	{
+		static const char s_aryCh[] = "0123456789abcdef";
+		for (int ib = 0; ib < cb; ++ib)
+		{
+			sz[2 * ib] = s_aryCh[pb[ib] >> 4];
+			sz[2 * ib + 1] = s_aryCh[pb[ib] & 0x0F];
+		}
+		sz[2 * cb] = '\0';
+	}
+
+	static int NibbleFromCh(char ch)
+	{
+		if (ch >= '0' && ch <= '9')
+			return ch - '0';
+		if (ch >= 'a' && ch <= 'f')
+			return ch - 'a' + 10;
+		if (ch >= 'A' && ch <= 'F')
+			return ch - 'A' + 10;
+		return -1;
+	}
+
+	static bool FBytesFromHex(const char* pch, int cb, byte* pb)
+	{
+		for (int ib = 0; ib < cb; ++ib)
+		{
+			int hi = NibbleFromCh(pch[2 * ib]);
+			int lo = NibbleFromCh(pch[2 * ib + 1]);
+			if (hi < 0 || lo < 0)
+				return false;
+			pb[ib] = (byte)((hi << 4) | lo);
+		}
+		return true;
+	}
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "Types.h"
+#include <atomic>
+
+// controller input, sampled by the 2A03 at the moment the game strobes or reads
+// $4016/$4017 instead of once before each frame
+
+// https://wiki.nesdev.com/w/index.php/Standard_controller
+
+enum Buttons : byte
+{
+	Button_A		= 1 << 0,	// first bit shifted out after a strobe
+	Button_B		= 1 << 1,
+	Button_Select	= 1 << 2,
+	Button_Start	= 1 << 3,
+	Button_Up		= 1 << 4,
+	Button_Down		= 1 << 5,
+	Button_Left		= 1 << 6,
+	Button_Right	= 1 << 7,
+};
+
+// the full button state of one controller port, taking effect on PHI2 cycle 'cycle'.
+// live input can be stamped 0 to take effect at the next sample, the 2A03 restamps
+// it with the cycle it was actually applied on when recording
+
+struct InputEvent
+{
+	u64 cycle;
+	byte iPort;		// 0 for $4016, 1 for $4017
+	byte buttons;	// Buttons
+};
+
+// lock free ring buffer of InputEvents.
+// one producer (the host input thread) and one consumer (the emulation thread).
+// events must be pushed in cycle order
+
+class InputQueue
+{
+public:
+	InputQueue()
+	: iHead(0)
+	, iTail(0)
+	{
+	}
+
+	// producer side. returns false if the queue is full
+
+	bool FPush(const InputEvent& ev)
+	{
+		u32 iHeadCur = iHead.load(std::memory_order_relaxed);
+		if (iHeadCur - iTail.load(std::memory_order_acquire) == C_EVENT)
+			return false;
+
+		aryEv[iHeadCur % C_EVENT] = ev;
+		iHead.store(iHeadCur + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side. pops the oldest event if it takes effect on or before cycle
+
+	bool FPop(u64 cycle, InputEvent* pEv)
+	{
+		u32 iTailCur = iTail.load(std::memory_order_relaxed);
+		if (iTailCur == iHead.load(std::memory_order_acquire))
+			return false;
+
+		const InputEvent& ev = aryEv[iTailCur % C_EVENT];
+		if (ev.cycle > cycle)
+			return false;
+
+		*pEv = ev;
+		iTail.store(iTailCur + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	static const u32 C_EVENT = 256; // power of 2, so the indices can wrap
+
+	InputEvent aryEv[C_EVENT];
+
+	// free running indices, iHead - iTail is the number of queued events.
+	// kept on separate cache lines so the two threads do not fight over them
+
+	__declspec(align(64)) std::atomic<u32> iHead;	// written by the producer
+	__declspec(align(64)) std::atomic<u32> iTail;	// written by the consumer
+};
@@ -0,0 +1,138 @@
+#pragma once
+#include "Types.h"
+#include "Arena.h"
+#include <cstring>
+#include <cassert>
+
+// memory split into pages that are shared copy-on-write between a machine and its clones.
+// cloning only copies the page table, a page is copied the first time a clone writes to it.
+
+// pages are 256 bytes, the same size as a 6502 page
+
+#define PAGE_SIZE 256
+
+struct MemPage
+{
+	int cRef;
+	byte ab[PAGE_SIZE];
+};
+
+// C_PAGE pages, addressed from 0 to (C_PAGE * PAGE_SIZE) - 1
+//
+// a page table entry is in one of two states
+// - zero: never written, reads come from a shared all zero page. no storage is owned
+// - owned: points at a ref counted MemPage, copied on write if any clone also points at it
+//
+// rom is not mapped here, it is read straight from the shared Rom
+//
+// pages come from the per thread Arena and ref counts are not atomic,
+// so a machine and all of its clones must live on one thread
+
+template <int C_PAGE>
+class CowMemory
+{
+public:
+	CowMemory()
+	{
+		for (int iPage = 0; iPage < C_PAGE; ++iPage)
+		{
+			aryPb[iPage] = AbZero();
+			aryPage[iPage] = nullptr;
+		}
+	}
+
+	CowMemory(const CowMemory& mem)
+	{
+		CopyFrom(mem);
+	}
+
+	CowMemory& operator=(const CowMemory& mem)
+	{
+		if (this != &mem)
+		{
+			Release();
+			CopyFrom(mem);
+		}
+		return *this;
+	}
+
+	~CowMemory()
+	{
+		Release();
+	}
+
+	byte Read(half addr) const
+	{
+		assert((addr >> 8) < C_PAGE);
+		return aryPb[addr >> 8][addr & 0xFF];
+	}
+
+	void Write(half addr, byte val)
+	{
+		assert((addr >> 8) < C_PAGE);
+		MemPage* pPage = aryPage[addr >> 8];
+		if (!pPage || pPage->cRef > 1)
+			pPage = PageWritable(addr >> 8);
+		pPage->ab[addr & 0xFF] = val;
+	}
+
+private:
+	// read pointer for each page. always valid
+	const byte* aryPb[C_PAGE];
+
+	// owned page for each page, null for zero pages
+	MemPage* aryPage[C_PAGE];
+
+	static const byte* AbZero()
+	{
+		static const byte s_abZero[PAGE_SIZE] = {};
+		return s_abZero;
+	}
+
+	// get a page we can write to, copying a shared page or materializing a zero page
+
+	MemPage* PageWritable(int iPage)
+	{
+		MemPage* pPageOld = aryPage[iPage];
+
+		MemPage* pPage = (MemPage*)ArenaThread().PvAlloc(sizeof(MemPage), 8);
+		pPage->cRef = 1;
+		memcpy(pPage->ab, aryPb[iPage], PAGE_SIZE);
+
+		if (pPageOld)
+			pPageOld->cRef--;
+
+		aryPage[iPage] = pPage;
+		aryPb[iPage] = pPage->ab;
+		return pPage;
+	}
+
+	void CopyFrom(const CowMemory& mem)
+	{
+		for (int iPage = 0; iPage < C_PAGE; ++iPage)
+		{
+			aryPb[iPage] = mem.aryPb[iPage];
+			aryPage[iPage] = mem.aryPage[iPage];
+			if (aryPage[iPage])
+				aryPage[iPage]->cRef++;
+		}
+	}
+
+	void ReleasePage(int iPage)
+	{
+		MemPage* pPage = aryPage[iPage];
+		if (pPage && --pPage->cRef == 0)
+			ArenaThread().Free(pPage, sizeof(MemPage));
+
+		aryPb[iPage] = AbZero();
+		aryPage[iPage] = nullptr;
+	}
+
+	void Release()
+	{
+		for (int iPage = 0; iPage < C_PAGE; ++iPage)
+		{
+			ReleasePage(iPage);
+		}
+	}
+};
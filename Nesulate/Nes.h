@@ -0,0 +1,191 @@
+#pragma once
+#include "Types.h"
+#include "Arena.h"
+#include "nesfile.h"
+#include "2A03.h"
+#include "6502.h"
+#include "2C03.h"
+#include "Debugger.h"
+#include "PpuThread.h"
+#include "Profiler.h"
+#include <new>
+#include <cstring>
+
+// one running machine.
+//
+// everything hot lives in this one cache line aligned block from the per thread Arena,
+// cpu registers first. the only other storage an instance owns are the memory pages it has
+// written (2Kb wram and 2Kb vram for an NROM game, plus prg/chr ram if the game uses it),
+// rom is referenced from the shared Rom.
+//
+// a machine and its clones share unwritten pages, so they must stay on the thread that
+// created them
+
+class __declspec(align(64)) Nes
+{
+public:
+	static Nes* Create(Rom* pRom)
+	{
+		void* pv = ArenaThread().PvAlloc(sizeof(Nes), 64);
+		return new (pv) Nes(pRom);
+	}
+
+	// fork this machine. the clone shares every memory page with us until one of us
+	// writes to it, so cloning costs a copy of this block, not of memory
+
+	Nes* Clone() const
+	{
+		// a ppu running on its own thread has to be caught up and idle to be copied
+		if (cpu6502.pPpuThread)
+			cpu6502.pPpuThread->CatchUp(cpu6502.cCycle);
+
+		void* pv = ArenaThread().PvAlloc(sizeof(Nes), 64);
+		return new (pv) Nes(*this);
+	}
+
+	void Destroy()
+	{
+		this->~Nes();
+		ArenaThread().Free(this, sizeof(Nes));
+	}
+
+	// run for at least cCycleRun cpu cycles, to the end of an instruction
+	void Run(u64 cCycleRun)
+	{
+		u64 cCycleEnd = cpu6502.cCycle + cCycleRun;
+		while (cpu6502.cCycle < cCycleEnd)
+		{
+			cpu6502.Cycle();
+		}
+	}
+
+	// cpu memory without side effects, for tools. ppu and io registers read as open bus
+	// and ignore writes
+
+	byte Peek(half addr)
+	{
+		return cpu6502.Peek(addr);
+	}
+
+	void Poke(half addr, byte val)
+	{
+		cpu6502.Poke(addr, val);
+	}
+
+	// a cpu bus access with its side effects, as if the instruction just run had made it.
+	// for tools and tests that poke at the ppu and io registers. traps fire as usual
+
+	byte Read(half addr)
+	{
+		return cpu6502.Read(addr);
+	}
+
+	void Write(half addr, byte val)
+	{
+		cpu6502.Write(addr, val);
+	}
+
+	// where controller input comes from, and where to record it, see CPU_2A03.
+	// either can be null. clones start with neither
+
+	void SetInput(InputQueue* pInputQueue, std::vector<InputEvent>* pInputRecord)
+	{
+		cpu2A03.pInputQueue = pInputQueue;
+		cpu2A03.pInputRecord = pInputRecord;
+	}
+
+	// attach to the cpu, see Debugger. clones start without one
+	void AttachDebugger(Debugger* pDebugger)
+	{
+		pDebugger->Attach(&cpu6502);
+	}
+
+	// start or stop (null) sampling the game's code, see GuestProfiler. clones start without one
+	void AttachProfiler(GuestProfiler* pProfiler)
+	{
+		cpu6502.pProfiler = pProfiler;
+
+		// pick up the profiler's schedule after the next instruction
+		cpu6502.cCycleSync = cpu6502.cCycle;
+	}
+
+	// sample every cCycleInterval cycles from now on, see GuestProfiler::SetInterval.
+	// change the interval here rather than on the profiler, so we pick up the new schedule
+	void SetProfilerInterval(u32 cCycleInterval)
+	{
+		if (!cpu6502.pProfiler)
+			return;
+
+		cpu6502.pProfiler->SetInterval(cCycleInterval, cpu6502.cCycle);
+		cpu6502.cCycleSync = cpu6502.cCycle;
+	}
+
+	// run the ppu on its own thread, see PpuThread. clones start with it inline
+	void SetPpuThreaded(bool fThreaded)
+	{
+		if (fThreaded == (cpu6502.pPpuThread != nullptr))
+			return;
+
+		if (fThreaded)
+		{
+			cpu6502.pPpuThread = new PpuThread(&ppu2C03);
+		}
+		else
+		{
+			delete cpu6502.pPpuThread;
+			cpu6502.pPpuThread = nullptr;
+		}
+
+		// start or stop publishing after the next instruction
+		cpu6502.cCycleSync = cpu6502.cCycle;
+	}
+
+private:
+	CPU_6502 cpu6502;
+	PPU_2C03 ppu2C03;
+	CPU_2A03 cpu2A03;
+
+	Nes(Rom* pRom)
+	{
+		pRom->AddRef();
+		cpu6502.pRom = pRom;
+		cpu6502.pPpu = &ppu2C03;
+		cpu6502.p2A03 = &cpu2A03;
+		ppu2C03.pRom = pRom;
+
+		memset(ppu2C03.aryPalette, 0, sizeof(ppu2C03.aryPalette));
+		memset(ppu2C03.aryOam, 0, sizeof(ppu2C03.aryOam));
+
+		// power on at the reset vector
+		cpu6502.pc = cpu6502.pReset();
+	}
+
+	Nes(const Nes& nes)
+	: cpu6502(nes.cpu6502)
+	, ppu2C03(nes.ppu2C03)
+	, cpu2A03(nes.cpu2A03)
+	{
+		cpu6502.pRom->AddRef();
+
+		cpu6502.aryPageTrap = CPU_6502::AryTrapNone();
+		cpu6502.pTrapHandler = nullptr;
+		cpu6502.pProfiler = nullptr;
+
+		// an InputQueue has one consumer, a clone that shared it would steal our input
+		cpu2A03.pInputQueue = nullptr;
+		cpu2A03.pInputRecord = nullptr;
+
+		cpu6502.pPpu = &ppu2C03;
+		cpu6502.p2A03 = &cpu2A03;
+		cpu6502.pPpuThread = nullptr;
+		cpu6502.cCycleSync = cpu6502.cCycleNmi;
+	}
+
+	~Nes()
+	{
+		delete cpu6502.pPpuThread;
+		cpu6502.pRom->Release();
+	}
+
+	Nes& operator=(const Nes&);
+};
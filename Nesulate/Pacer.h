@@ -0,0 +1,320 @@
+#pragma once
+#include "Types.h"
+#include <atomic>
+#include <cmath>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// frame pacing for interactive use, with the audio device as the master clock.
+//
+// the emulation thread pushes each frame's audio into an AudioRing and calls
+// FramePacer::EndFrame, which sleeps (never spins) until the ring has drained back
+// down to its target fill. so the emulator runs exactly as fast as the sound card plays.
+// the small mismatch between the NES's 60.0988 Hz and the host's clocks is absorbed by
+// nudging the resampling ratio up or down a fraction of a percent with the fill level,
+// instead of letting the ring run dry or overflow.
+// see https://docs.libretro.com/development/cores/dynamic-rate-control/
+
+// monotonic time in nanoseconds
+
+inline u64 NsNow()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER s_freq;
+	if (!s_freq.QuadPart)
+		QueryPerformanceFrequency(&s_freq);
+
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (u64)(count.QuadPart / s_freq.QuadPart) * 1000000000 +
+		(u64)(count.QuadPart % s_freq.QuadPart) * 1000000000 / s_freq.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// block until NsNow() >= ns, on a high resolution timer
+
+inline void SleepUntilNs(u64 ns)
+{
+#ifdef _WIN32
+	// high resolution waitable timers are windows 10 1803 and up, fall back to a regular one
+	static HANDLE s_hTimer = nullptr;
+	if (!s_hTimer)
+		s_hTimer = CreateWaitableTimerExW(nullptr, nullptr, 0x00000002 /* CREATE_WAITABLE_TIMER_HIGH_RESOLUTION */, TIMER_ALL_ACCESS);
+	if (!s_hTimer)
+		s_hTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+
+	u64 nsNow = NsNow();
+	if (ns <= nsNow)
+		return;
+
+	// negative is relative, in 100ns units
+	LARGE_INTEGER due;
+	due.QuadPart = -(LONGLONG)((ns - nsNow) / 100);
+	SetWaitableTimer(s_hTimer, &due, 0, nullptr, nullptr, FALSE);
+	WaitForSingleObject(s_hTimer, INFINITE);
+#else
+	timespec ts;
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0)
+	{
+		// interrupted by a signal, go back to sleep
+	}
+#endif
+}
+
+// lock free ring buffer of 16 bit mono samples.
+// one producer (the emulation thread) and one consumer (the audio device callback)
+
+class AudioRing
+{
+public:
+	AudioRing()
+	: iHead(0)
+	, iTail(0)
+	, cUnderrun(0)
+	{
+	}
+
+	static const u32 C_SAMPLE_MAX = 16 * KB;	// power of 2, so the indices can wrap
+
+	// producer side. returns how many samples fit
+
+	u32 Push(const s16* aSample, u32 cSample)
+	{
+		u32 iHeadCur = iHead.load(std::memory_order_relaxed);
+		u32 cFree = C_SAMPLE_MAX - (iHeadCur - iTail.load(std::memory_order_acquire));
+		if (cSample > cFree)
+			cSample = cFree;
+
+		for (u32 iSample = 0; iSample < cSample; ++iSample)
+		{
+			arySample[(iHeadCur + iSample) % C_SAMPLE_MAX] = aSample[iSample];
+		}
+
+		iHead.store(iHeadCur + cSample, std::memory_order_release);
+		return cSample;
+	}
+
+	// consumer side. always fills cSample, with silence if we run dry
+
+	void Pull(s16* aSample, u32 cSample)
+	{
+		u32 iTailCur = iTail.load(std::memory_order_relaxed);
+		u32 cAvail = iHead.load(std::memory_order_acquire) - iTailCur;
+
+		u32 cCopy = cSample < cAvail ? cSample : cAvail;
+		for (u32 iSample = 0; iSample < cCopy; ++iSample)
+		{
+			aSample[iSample] = arySample[(iTailCur + iSample) % C_SAMPLE_MAX];
+		}
+
+		if (cCopy < cSample)
+		{
+			for (u32 iSample = cCopy; iSample < cSample; ++iSample)
+			{
+				aSample[iSample] = 0;
+			}
+			cUnderrun++;
+		}
+
+		iTail.store(iTailCur + cCopy, std::memory_order_release);
+	}
+
+	// samples waiting to be played
+	u32 CSample() const
+	{
+		return iHead.load(std::memory_order_acquire) - iTail.load(std::memory_order_acquire);
+	}
+
+	u32 CUnderrun() const
+	{
+		return cUnderrun.load(std::memory_order_relaxed);
+	}
+
+private:
+	s16 arySample[C_SAMPLE_MAX];
+
+	// free running indices, kept on separate cache lines so the two threads do not fight over them
+	__declspec(align(64)) std::atomic<u32> iHead;	// written by the producer
+	__declspec(align(64)) std::atomic<u32> iTail;	// written by the consumer
+	std::atomic<u32> cUnderrun;
+};
+
+// what the pacer has seen since the last ResetStats, to tune the ring's target fill
+
+struct PacerStats
+{
+	u64 cFrame;
+	u32 cUnderrun;
+	u32 cSampleDropped;		// pushed while the ring was full, and lost
+
+	// audio queued at the end of a frame, the latency from emulation to speaker
+	double msLatency;
+	double msLatencyMin;
+	double msLatencyMax;
+
+	// time from one EndFrame to the next
+	double msFrameMean;
+	double msFrameJitter;	// standard deviation
+	double msFrameMax;
+
+	// the resampling ratio applied to the last frame, around 1
+	double ratio;
+};
+
+class FramePacer
+{
+public:
+	// sampleRateIn is the rate the emulator makes samples at, sampleRateOut the device's.
+	// cSampleTarget is the fill level to hold the ring at: lower for less latency,
+	// higher for fewer underruns
+	FramePacer(AudioRing* pRing, u32 sampleRateIn, u32 sampleRateOut, u32 cSampleTarget)
+	: pRing(pRing)
+	, sampleRateOut(sampleRateOut)
+	, cSampleTarget(cSampleTarget)
+	, ratioBase((double)sampleRateOut / sampleRateIn)
+	, ratio(1.0)
+	, posResample(0.0)
+	, sampleLast(0)
+	, nsFrameLast(0)
+	{
+		ResetStats();
+	}
+
+	// push one frame of audio, resampled to the device rate by the current ratio
+
+	void PushAudio(const s16* aSample, u32 cSample)
+	{
+		// linear interpolation between the last sample and each new one
+
+		double dPos = 1.0 / (ratioBase * ratio);
+
+		s16 arySampleOut[512];
+		u32 cSampleOut = 0;
+
+		for (u32 iSample = 0; iSample < cSample; ++iSample)
+		{
+			s16 sample = aSample[iSample];
+			while (posResample < 1.0)
+			{
+				arySampleOut[cSampleOut++] = (s16)(sampleLast + (sample - sampleLast) * posResample);
+				posResample += dPos;
+
+				if (cSampleOut == sizeof(arySampleOut) / sizeof(arySampleOut[0]))
+				{
+					Push(arySampleOut, cSampleOut);
+					cSampleOut = 0;
+				}
+			}
+
+			posResample -= 1.0;
+			sampleLast = sample;
+		}
+
+		Push(arySampleOut, cSampleOut);
+	}
+
+	// call once the frame's audio is pushed. sleeps off whatever is queued past the target,
+	// then picks the ratio for the next frame from how full the ring is
+
+	void EndFrame()
+	{
+		u32 cSample = pRing->CSample();
+		if (cSample > cSampleTarget)
+			SleepUntilNs(NsNow() + (u64)(cSample - cSampleTarget) * 1000000000 / sampleRateOut);
+
+		u64 nsNow = NsNow();
+		cSample = pRing->CSample();
+
+		// below the target, make a little more audio per frame so it fills back up.
+		// above, a little less. never more than RatioDeltaMax(), which is inaudible
+
+		double fill = (double)((s32)cSampleTarget - (s32)cSample) / cSampleTarget;
+		ratio = 1.0 + RatioDeltaMax() * (fill < -1.0 ? -1.0 : fill > 1.0 ? 1.0 : fill);
+
+		// stats
+
+		double msLatency = cSample * 1000.0 / sampleRateOut;
+		stats.msLatency = msLatency;
+		if (stats.cFrame == 0 || msLatency < stats.msLatencyMin)
+			stats.msLatencyMin = msLatency;
+		if (msLatency > stats.msLatencyMax)
+			stats.msLatencyMax = msLatency;
+
+		if (nsFrameLast)
+		{
+			// welford's running mean and variance
+			double msFrame = (nsNow - nsFrameLast) / 1000000.0;
+			cFrameTimed++;
+			double dMs = msFrame - stats.msFrameMean;
+			stats.msFrameMean += dMs / cFrameTimed;
+			msFrameM2 += dMs * (msFrame - stats.msFrameMean);
+			stats.msFrameJitter = sqrt(msFrameM2 / cFrameTimed);
+
+			if (msFrame > stats.msFrameMax)
+				stats.msFrameMax = msFrame;
+		}
+
+		nsFrameLast = nsNow;
+		stats.cFrame++;
+		stats.cUnderrun = pRing->CUnderrun() - cUnderrunReset;
+		stats.ratio = ratio;
+	}
+
+	const PacerStats& Stats() const
+	{
+		return stats;
+	}
+
+	void ResetStats()
+	{
+		stats = PacerStats();
+		cFrameTimed = 0;
+		msFrameM2 = 0.0;
+		cUnderrunReset = pRing->CUnderrun();
+	}
+
+private:
+	// half a percent. a function, since a header cannot define a static double member
+	static double RatioDeltaMax()
+	{
+		return 0.005;
+	}
+
+	// the ring only takes what fits. the rest is dropped, which means the target fill is
+	// too close to the ring's size or the consumer has stalled
+	void Push(const s16* aSample, u32 cSample)
+	{
+		stats.cSampleDropped += cSample - pRing->Push(aSample, cSample);
+	}
+
+	AudioRing* pRing;
+	u32 sampleRateOut;
+	u32 cSampleTarget;
+
+	double ratioBase;		// sampleRateOut / sampleRateIn
+	double ratio;			// rate control, multiplies ratioBase
+
+	// resampler state
+	double posResample;		// position between sampleLast and the next input sample
+	s16 sampleLast;
+
+	// stats
+	PacerStats stats;
+	u64 nsFrameLast;
+	u64 cFrameTimed;
+	double msFrameM2;
+	u32 cUnderrunReset;
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include "Types.h"
+#include "2C03.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// runs a PPU_2C03 on its own thread, alongside the cpu.
+//
+// the cpu publishes how far it has got, and the ppu thread runs up to that point and
+// never past it, so nothing the cpu does later can change what the ppu already did.
+// when the cpu needs the ppu's state (a register access, OAM DMA, or the cycle the next
+// NMI is due) it calls CatchUp, which stalls until the ppu thread has got there.
+// the ppu then sits idle until the cpu publishes again, so the cpu has the ppu to itself.
+//
+// whichever side has nothing to do blocks on a condition variable rather than spinning,
+// so a ppu with nothing published costs no cpu time. the other side only takes the lock
+// to wake it when it is actually waiting, so the common Publish is one store and one load.
+//
+// the ppu runs the same dots with the same inputs as it would inline,
+// so the result is bit for bit the same as the single threaded path
+
+class PpuThread
+{
+public:
+	PpuThread(PPU_2C03* pPpu)
+	: pPpu(pPpu)
+	, cDotPublished(pPpu->cDot)
+	, fCpuWaiting(false)
+	, cDotDone(pPpu->cDot)
+	, fPpuWaiting(false)
+	, fStop(false)
+	{
+		thread = std::thread(&PpuThread::Run, this);
+	}
+
+	// the ppu is caught up to whatever was last published once this returns
+	~PpuThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			fStop.store(true);
+		}
+		cvPublished.notify_one();
+		thread.join();
+	}
+
+	// let the ppu run up to cpu cycle cCycle
+	void Publish(u64 cCycle)
+	{
+		cDotPublished.store(cCycle * C_DOT_CYCLE);
+
+		// a ppu thread that checked before the store above is waiting, or about to, and we
+		// see fPpuWaiting. one that checks after it sees the new cDotPublished
+		if (fPpuWaiting.load())
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cvPublished.notify_one();
+		}
+	}
+
+	// run the ppu up to cpu cycle cCycle, and wait for it to get there
+	void CatchUp(u64 cCycle)
+	{
+		u64 cDotTarget = cCycle * C_DOT_CYCLE;
+		Publish(cCycle);
+
+		if (cDotDone.load(std::memory_order_acquire) >= cDotTarget)
+			return;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		fCpuWaiting.store(true);
+		while (cDotDone.load() < cDotTarget)
+		{
+			cvDone.wait(lock);
+		}
+		fCpuWaiting.store(false);
+	}
+
+private:
+	PPU_2C03* pPpu;
+
+	// written by the cpu thread
+	__declspec(align(64)) std::atomic<u64> cDotPublished;
+	std::atomic<bool> fCpuWaiting;		// blocked in CatchUp
+
+	// written by the ppu thread
+	__declspec(align(64)) std::atomic<u64> cDotDone;
+	std::atomic<bool> fPpuWaiting;		// blocked for something to be published
+
+	// only taken to block or to wake the other side
+	std::mutex mutex;
+	std::condition_variable cvPublished;
+	std::condition_variable cvDone;
+
+	std::atomic<bool> fStop;
+	std::thread thread;
+
+	void Run()
+	{
+		for (;;)
+		{
+			u64 cDotTarget = cDotPublished.load(std::memory_order_acquire);
+			if (cDotTarget > pPpu->cDot)
+			{
+				pPpu->RunTo(cDotTarget);
+				cDotDone.store(cDotTarget);
+
+				if (fCpuWaiting.load())
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					cvDone.notify_one();
+				}
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+
+			// on stop, finish whatever was published before it
+			if (fStop.load())
+			{
+				pPpu->RunTo(cDotPublished.load());
+				return;
+			}
+
+			fPpuWaiting.store(true);
+			while (cDotPublished.load() <= pPpu->cDot && !fStop.load())
+			{
+				cvPublished.wait(lock);
+			}
+			fPpuWaiting.store(false);
+		}
+	}
+};
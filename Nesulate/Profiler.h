@@ -0,0 +1,186 @@
+#pragma once
+#include "Types.h"
+#include "nesfile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+// sampling profiler for the game's own 6502 code.
+//
+// the cpu reports JSR, BRK and NMI entry, and RTS/RTI, and we keep a shadow of the call
+// stack from them. every cCycleInterval cycles (give or take, so we do not alias with
+// loops that run in step with the frame) the cpu asks us to sample, and we count the
+// current stack. the counts come out as folded stacks, one line per distinct stack:
+//
+//   reset;bank00:$C1A0;nmi:bank01:$8004 1234
+//
+// which is what flamegraph.pl and most flame graph viewers take.
+// see https://github.com/brendangregg/FlameGraph
+//
+// games often pull return addresses off the stack or push one and RTS to jump, so frames
+// are not popped one per return. each frame remembers sp after its call, and a return
+// pops every frame deeper than the sp it returns to
+
+enum FrameKind : byte
+{
+	FrameKind_Call,		// JSR
+	FrameKind_Nmi,
+	FrameKind_Brk,
+};
+
+class GuestProfiler
+{
+public:
+	// sampling every cCycleInterval cpu cycles. the default is about 180 samples a second
+	// of emulated time, cheap enough to leave on
+	GuestProfiler(const Rom* pRom, u32 cCycleInterval = 10000)
+	: pRom(pRom)
+	, cCycleInterval(cCycleInterval)
+	, cCycleNext(cCycleInterval)
+	, cFrame(0)
+	, fSamplePc(true)
+	, seed(1)
+	{
+	}
+
+	// count the exact pc as the innermost frame, as well as the routine it is in. on by
+	// default, off folds each routine into one frame for a smaller, coarser graph
+	void SetSamplePc(bool fSamplePcNew)
+	{
+		fSamplePc = fSamplePcNew;
+	}
+
+	// the cpu samples once its cycle count reaches this
+	u64 CCycleNext() const
+	{
+		return cCycleNext;
+	}
+
+	// CPU HOOKS
+
+	// entered the routine at addr. sp is after the return address was pushed
+	void OnCall(half addr, half sp, FrameKind kind)
+	{
+		if (cFrame == C_FRAME_MAX)
+			return;
+
+		aryFrame[cFrame].key = KeyFromAddr(addr, kind);
+		aryFrame[cFrame].sp = sp;
+		cFrame++;
+	}
+
+	// RTS or RTI. sp is after the return address was pulled
+	void OnReturn(half sp)
+	{
+		while (cFrame > 0 && aryFrame[cFrame - 1].sp < sp)
+		{
+			cFrame--;
+		}
+	}
+
+	void Sample(half pc, u64 cCycle)
+	{
+		std::vector<u32> aryKey(cFrame + (fSamplePc ? 1 : 0));
+		for (int iFrame = 0; iFrame < cFrame; ++iFrame)
+		{
+			aryKey[iFrame] = aryFrame[iFrame].key;
+		}
+		if (fSamplePc)
+			aryKey[cFrame] = KeyFromAddr(pc, FrameKind_Call);
+
+		mpStackCount[aryKey]++;
+
+		Reschedule(cCycle);
+	}
+
+	// OUTPUT
+
+	void WriteFolded(FILE* pFile) const
+	{
+		for (std::map<std::vector<u32>, u64>::const_iterator it = mpStackCount.begin(); it != mpStackCount.end(); ++it)
+		{
+			fputs("reset", pFile);
+			for (size_t iKey = 0; iKey < it->first.size(); ++iKey)
+			{
+				char szFrame[32];
+				SzFromKey(it->first[iKey], szFrame, sizeof(szFrame));
+				fprintf(pFile, ";%s", szFrame);
+			}
+			fprintf(pFile, " %llu\n", (unsigned long long)it->second);
+		}
+	}
+
+	void Clear()
+	{
+		mpStackCount.clear();
+	}
+
+private:
+	// Nes::SetProfilerInterval changes the interval, since the cpu has to pick up the
+	// new CCycleNext too
+
+	friend class Nes;
+
+	// takes effect now, not after the sample already scheduled. cCycleNow is the cpu's
+	// cycle count
+	void SetInterval(u32 cCycleIntervalNew, u64 cCycleNow)
+	{
+		cCycleInterval = cCycleIntervalNew;
+		Reschedule(cCycleNow);
+	}
+
+	// 6502 stack is 256 bytes, at least 2 of them per call
+	static const int C_FRAME_MAX = 128;
+
+	struct Frame
+	{
+		u32 key;
+		half sp;
+	};
+
+	const Rom* pRom;
+	u32 cCycleInterval;
+	u64 cCycleNext;
+
+	Frame aryFrame[C_FRAME_MAX];
+	int cFrame;
+
+	bool fSamplePc;
+	u32 seed;
+
+	std::map<std::vector<u32>, u64> mpStackCount;
+
+	// a frame packed in a u32
+	//  kind << 24 | bank << 16 | addr, bank is 0xFF outside prg rom
+
+	// next sample in cCycleInterval, +/- an eighth
+	void Reschedule(u64 cCycle)
+	{
+		seed = seed * 1103515245 + 12345;
+		u32 cCycleJitter = cCycleInterval / 4;
+		cCycleNext = cCycle + cCycleInterval - cCycleInterval / 8 + (cCycleJitter ? (seed >> 8) % cCycleJitter : 0);
+	}
+
+	u32 KeyFromAddr(half addr, FrameKind kind) const
+	{
+		u32 bank = (addr >= 0x8000) ? pRom->IBankPrg(addr) : 0xFF;
+		return ((u32)kind << 24) | ((bank & 0xFF) << 16) | addr;
+	}
+
+	static void SzFromKey(u32 key, char* szFrame, size_t cchFrame)
+	{
+		static const char* s_arySzKind[] = { "", "nmi:", "brk:" };
+
+		const char* szKind = s_arySzKind[(key >> 24) & 0x03];
+		u32 bank = (key >> 16) & 0xFF;
+		half addr = key & 0xFFFF;
+
+		if (bank != 0xFF)
+			SNPRINTF(szFrame, cchFrame, "%sbank%02x:$%04X", szKind, bank, addr);
+		else if (addr < 0x2000)
+			SNPRINTF(szFrame, cchFrame, "%sram:$%04X", szKind, addr);
+		else
+			SNPRINTF(szFrame, cchFrame, "%sprgram:$%04X", szKind, addr);
+	}
+};
@@ -20,12 +20,19 @@ typedef u64 dword;
 
 #define KB 1024
 
-half HalfAt(void* ptr)
+// bounded sprintf. msvc before 2015 has no snprintf, and flags sprintf as unsafe
+#ifdef _MSC_VER
+#define SNPRINTF(sz, cch, ...) _snprintf_s(sz, cch, _TRUNCATE, __VA_ARGS__)
+#else
+#define SNPRINTF snprintf
+#endif
+
+inline half HalfAt(void* ptr)
 {
 	return *(half*)ptr;
 }
 
-word WordAt(void* ptr)
+inline word WordAt(void* ptr)
 {
 	return *(word*)ptr;
 }
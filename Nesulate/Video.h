@@ -0,0 +1,507 @@
+#pragma once
+#include "Types.h"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// the AVX2 paths are compiled in whatever the target architecture, and picked at run time.
+// msvc allows AVX2 intrinsics in any function, gcc and clang need to be told per function
+
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// frame output. converts the 2C03's indexed pixels to RGBA or YUV for the host,
+// either with a flat palette lookup or through a model of the NTSC composite signal
+
+// a frame is FRAME_WIDTH * FRAME_HEIGHT pixels, one half each
+//
+//  8      0
+//  ---- ----
+//  eee ll cccc
+//  ||| || ||||
+//  ||| || ++++- color (hue), 0 is gray, 13-15 are black
+//  ||| ++------ level (brightness)
+//  +++--------- emphasis bits from $2001, red green blue
+
+#define FRAME_WIDTH 256
+#define FRAME_HEIGHT 240
+#define C_PIXEL_INDEX 512
+
+// the ntsc filter has two output pixels per input pixel
+#define NTSC_WIDTH (2 * FRAME_WIDTH)
+
+// https://wiki.nesdev.com/w/index.php/NTSC_video
+
+// the 2C03 outputs 8 samples of composite signal per pixel,
+// 12 samples per cycle of the color subcarrier
+
+#define C_SAMPLE_PIXEL 8
+#define C_SAMPLE_CYCLE 12
+
+// every 3 pixels the subcarrier phase repeats, so a pixel starts on one of 3 phases
+#define C_PIXEL_PHASE 3
+
+// a pixel's signal reaches the output pixels of this many neighbors (2 on either side)
+#define C_NTSC_TAP 5
+
+// RGBA and YUV pixels are 4 bytes, in memory order R G B A, or Y U V A
+
+class Video
+{
+public:
+
+	Video()
+	: fAvx2(false)
+	, iJob(0)
+	, cBandDone(0)
+	, fStop(false)
+	{
+	}
+
+	~Video()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			fStop = true;
+		}
+		cvWork.notify_all();
+
+		for (size_t iThread = 0; iThread < aryThread.size(); ++iThread)
+		{
+			aryThread[iThread].join();
+		}
+	}
+
+	// build the palettes and filter kernels. call once before anything else.
+	// with cThread > 1 the ntsc filter splits each frame into that many horizontal bands,
+	// filtered in parallel by cThread - 1 worker threads started here and the calling thread
+
+	void Init(int cThread = 1)
+	{
+		fAvx2 = FCpuAvx2();
+
+		for (int iPixel = 0; iPixel < C_PIXEL_INDEX; ++iPixel)
+		{
+			// a flat field, decoded over one whole subcarrier cycle
+
+			float y = 0, i = 0, q = 0;
+			for (int phase = 0; phase < C_SAMPLE_CYCLE; ++phase)
+			{
+				float signal = Signal(iPixel, phase);
+				y += signal;
+				i += signal * cosf(RadFromPhase(phase));
+				q += signal * sinf(RadFromPhase(phase));
+			}
+			y /= C_SAMPLE_CYCLE;
+			i *= 2.0f / C_SAMPLE_CYCLE;
+			q *= 2.0f / C_SAMPLE_CYCLE;
+
+			float r, g, b;
+			RgbFromYiq(y, i, q, &r, &g, &b);
+			aryRgba[iPixel] = RgbaFromRgb(r, g, b);
+			aryYuv[iPixel] = YuvFromRgb(r, g, b);
+		}
+
+		InitNtscKernels();
+
+		if (cThread > FRAME_HEIGHT)
+			cThread = FRAME_HEIGHT;
+
+		for (int iBand = 0; iBand < cThread - 1; ++iBand)
+		{
+			aryThread.push_back(std::thread(&Video::Worker, this, iBand, cThread));
+		}
+	}
+
+	// palette lookup for a whole frame, to FRAME_WIDTH * FRAME_HEIGHT pixels
+
+	void ToRgba(const half* aPixel, u32* aRgba) const
+	{
+		Lookup(aryRgba, aPixel, aRgba, FRAME_WIDTH * FRAME_HEIGHT);
+	}
+
+	void ToYuv(const half* aPixel, u32* aYuv) const
+	{
+		Lookup(aryYuv, aPixel, aYuv, FRAME_WIDTH * FRAME_HEIGHT);
+	}
+
+	// run a frame through the composite signal, to NTSC_WIDTH * FRAME_HEIGHT RGBA pixels.
+	// iFrame picks the subcarrier phase of the first scanline, which the real console
+	// moves from frame to frame
+
+	void NtscToRgba(const half* aPixel, u32* aRgba, int iFrame)
+	{
+		int cBand = (int)aryThread.size() + 1;
+		if (cBand == 1)
+		{
+			NtscBand(aPixel, aRgba, iFrame, 0, FRAME_HEIGHT);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			aPixelJob = aPixel;
+			aRgbaJob = aRgba;
+			iFrameJob = iFrame;
+			cBandDone = 0;
+			iJob++;
+		}
+		cvWork.notify_all();
+
+		// the calling thread does the last band itself
+		NtscBand(aPixel, aRgba, iFrame, FRAME_HEIGHT * (cBand - 1) / cBand, FRAME_HEIGHT);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		cvDone.wait(lock, [&]{ return cBandDone == cBand - 1; });
+	}
+
+private:
+	u32 aryRgba[C_PIXEL_INDEX];
+	u32 aryYuv[C_PIXEL_INDEX];
+
+	// for each starting phase and pixel index, that pixel's contribution to the output of
+	// itself and its neighbors. each tap is two output pixels of R G B and an unused 0,
+	// eight floats, so one tap is one AVX register.
+	// loaded unaligned, a Video from new is not guaranteed the alignment
+	__declspec(align(32)) float aryKernel[C_PIXEL_PHASE][C_PIXEL_INDEX][C_NTSC_TAP * 8];
+
+	bool fAvx2;
+
+	// ntsc worker threads, each waits for iJob to change then filters its band of the job
+
+	std::vector<std::thread> aryThread;
+	std::mutex mutex;
+	std::condition_variable cvWork;
+	std::condition_variable cvDone;
+
+	u32 iJob;
+	const half* aPixelJob;
+	u32* aRgbaJob;
+	int iFrameJob;
+	int cBandDone;
+	bool fStop;
+
+	void Worker(int iBand, int cBand)
+	{
+		int yMic = FRAME_HEIGHT * iBand / cBand;
+		int yMac = FRAME_HEIGHT * (iBand + 1) / cBand;
+		u32 iJobDone = 0;
+
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cvWork.wait(lock, [&]{ return fStop || iJob != iJobDone; });
+				if (fStop)
+					return;
+				iJobDone = iJob;
+			}
+
+			NtscBand(aPixelJob, aRgbaJob, iFrameJob, yMic, yMac);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				cBandDone++;
+			}
+			cvDone.notify_one();
+		}
+	}
+
+	// AVX2 and the OS saving the ymm registers
+	static bool FCpuAvx2()
+	{
+#if defined(_MSC_VER)
+		int aryInfo[4];
+		__cpuid(aryInfo, 0);
+		if (aryInfo[0] < 7)
+			return false;
+
+		__cpuid(aryInfo, 1);
+		bool fOsxsave = (aryInfo[2] & (1 << 27)) != 0;
+		bool fAvx = (aryInfo[2] & (1 << 28)) != 0;
+		if (!fOsxsave || !fAvx || (_xgetbv(0) & 0x06) != 0x06)
+			return false;
+
+		__cpuidex(aryInfo, 7, 0);
+		return (aryInfo[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	// SIGNAL
+
+	// true for the half of the subcarrier cycle where color is high
+	static bool FInColorPhase(int color, int phase)
+	{
+		return (color + phase) % C_SAMPLE_CYCLE < 6;
+	}
+
+	// composite signal of a pixel at one phase of the subcarrier, 0 black to 1 white
+	static float Signal(int iPixel, int phase)
+	{
+		// voltage levels relative to sync
+
+		static const float aryLow[4]  = { 0.350f, 0.518f, 0.962f, 1.550f };
+		static const float aryHigh[4] = { 1.094f, 1.506f, 1.962f, 1.962f };
+		static const float black = 0.518f;
+		static const float white = 1.962f;
+		static const float attenuation = 0.746f;
+
+		int color = iPixel & 0x0F;
+		int level = (iPixel >> 4) & 0x03;
+		int emphasis = iPixel >> 6;
+
+		// colors 14 and 15 are forced to level 1
+		if (color > 13)
+			level = 1;
+
+		float low = aryLow[level];
+		float high = aryHigh[level];
+
+		// color 0 is only high, 13-15 only low
+		if (color == 0)
+			low = high;
+		if (color > 12)
+			high = low;
+
+		float signal = FInColorPhase(color, phase) ? high : low;
+
+		// each emphasis bit attenuates the signal for its third of the cycle
+		if (((emphasis & 1) && FInColorPhase(0, phase)) ||
+			((emphasis & 2) && FInColorPhase(4, phase)) ||
+			((emphasis & 4) && FInColorPhase(8, phase)))
+		{
+			signal *= attenuation;
+		}
+
+		return (signal - black) / (white - black);
+	}
+
+	// angle of the subcarrier at a phase, including the decoder's hue adjustment
+	static float RadFromPhase(int phase)
+	{
+		static const float hue = 3.0f;	// in samples
+		return 3.14159265f * (phase + 0.5f + hue) / 6.0f;
+	}
+
+	// FCC NTSC
+	static void RgbFromYiq(float y, float i, float q, float* pR, float* pG, float* pB)
+	{
+		*pR = y + 0.956f * i + 0.621f * q;
+		*pG = y - 0.272f * i - 0.647f * q;
+		*pB = y - 1.106f * i + 1.703f * q;
+	}
+
+	static byte ByteFromUnit(float f)
+	{
+		if (f <= 0.0f)
+			return 0;
+		if (f >= 1.0f)
+			return 255;
+		return (byte)(f * 255.0f + 0.5f);
+	}
+
+	static u32 RgbaFromRgb(float r, float g, float b)
+	{
+		return ByteFromUnit(r) | (ByteFromUnit(g) << 8) | (ByteFromUnit(b) << 16) | 0xFF000000;
+	}
+
+	// BT.601, video range
+	static u32 YuvFromRgb(float r, float g, float b)
+	{
+		r = r < 0 ? 0 : r > 1 ? 1 : r;
+		g = g < 0 ? 0 : g > 1 ? 1 : g;
+		b = b < 0 ? 0 : b > 1 ? 1 : b;
+
+		float y = 0.299f * r + 0.587f * g + 0.114f * b;
+		float u = 0.564f * (b - y);
+		float v = 0.713f * (r - y);
+
+		byte bY = (byte)(16.0f + 219.0f * y + 0.5f);
+		byte bU = (byte)(128.0f + 224.0f * u + 0.5f);
+		byte bV = (byte)(128.0f + 224.0f * v + 0.5f);
+		return bY | (bU << 8) | (bV << 16) | 0xFF000000;
+	}
+
+	// PALETTE LOOKUP
+
+	void Lookup(const u32* aTable, const half* aPixel, u32* aOut, int cPixel) const
+	{
+		int iPixel = fAvx2 ? LookupAvx2(aTable, aPixel, aOut, cPixel) : 0;
+
+		for (; iPixel < cPixel; ++iPixel)
+		{
+			aOut[iPixel] = aTable[aPixel[iPixel] & (C_PIXEL_INDEX - 1)];
+		}
+	}
+
+	// widen 8 indices to 32 bits and gather their colors in one go.
+	// returns how many pixels were done, a multiple of 8
+
+	TARGET_AVX2 static int LookupAvx2(const u32* aTable, const half* aPixel, u32* aOut, int cPixel)
+	{
+		int iPixel = 0;
+
+		const __m256i maskIndex = _mm256_set1_epi32(C_PIXEL_INDEX - 1);
+		for (; iPixel + 8 <= cPixel; iPixel += 8)
+		{
+			__m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(aPixel + iPixel)));
+			index = _mm256_and_si256(index, maskIndex);
+			__m256i color = _mm256_i32gather_epi32((const int*)aTable, index, 4);
+			_mm256_storeu_si256((__m256i*)(aOut + iPixel), color);
+		}
+
+		return iPixel;
+	}
+
+	// NTSC FILTER
+
+	// the decoder is linear, so the output is the sum of each input pixel's signal
+	// decoded on its own. that decoding is done once here, for every pixel index at
+	// every phase it can start on
+
+	void InitNtscKernels()
+	{
+		// low pass filters, triangles. luma is sharper than chroma
+
+		static const int dSampleLuma = 6;
+		static const int dSampleChroma = 12;
+		static const float normLuma = 1.0f / (dSampleLuma * dSampleLuma);
+		static const float normChroma = 2.0f / (dSampleChroma * dSampleChroma);
+
+		for (int iPhase = 0; iPhase < C_PIXEL_PHASE; ++iPhase)
+		{
+			int phasePixel = iPhase * C_SAMPLE_PIXEL % C_SAMPLE_CYCLE;
+
+			for (int iPixel = 0; iPixel < C_PIXEL_INDEX; ++iPixel)
+			{
+				float* pKernel = aryKernel[iPhase][iPixel];
+
+				for (int iTap = 0; iTap < C_NTSC_TAP; ++iTap)
+				{
+					for (int iOut = 0; iOut < 2; ++iOut)
+					{
+						// center of the output pixel, in samples from the start of our pixel
+
+						int sampleOut = (iTap - C_NTSC_TAP / 2) * C_SAMPLE_PIXEL + iOut * 4 + 2;
+
+						float y = 0, i = 0, q = 0;
+						for (int iSample = 0; iSample < C_SAMPLE_PIXEL; ++iSample)
+						{
+							int phase = (phasePixel + iSample) % C_SAMPLE_CYCLE;
+							int dSample = abs(iSample - sampleOut);
+							float signal = Signal(iPixel, phase);
+
+							if (dSample < dSampleLuma)
+								y += signal * (dSampleLuma - dSample) * normLuma;
+
+							if (dSample < dSampleChroma)
+							{
+								float w = signal * (dSampleChroma - dSample) * normChroma;
+								i += w * cosf(RadFromPhase(phase));
+								q += w * sinf(RadFromPhase(phase));
+							}
+						}
+
+						float* pOut = pKernel + iTap * 8 + iOut * 4;
+						RgbFromYiq(y, i, q, &pOut[0], &pOut[1], &pOut[2]);
+						pOut[3] = 0;
+					}
+				}
+			}
+		}
+	}
+
+	void NtscBand(const half* aPixel, u32* aRgba, int iFrame, int yMic, int yMac) const
+	{
+		// the line's kernels, padded with black (which has an all zero kernel)
+		// for the taps that fall off either end of the line
+
+		const float* aryPKernel[FRAME_WIDTH + C_NTSC_TAP - 1];
+		for (int x = 0; x < C_NTSC_TAP / 2; ++x)
+		{
+			aryPKernel[x] = aryKernel[0][0x0F];
+			aryPKernel[FRAME_WIDTH + C_NTSC_TAP / 2 + x] = aryKernel[0][0x0F];
+		}
+
+		for (int y = yMic; y < yMac; ++y)
+		{
+			const half* aPixelLine = aPixel + y * FRAME_WIDTH;
+			u32* aRgbaLine = aRgba + y * NTSC_WIDTH;
+
+			// each scanline is 341 pixels, so it starts 341 % 3 = 2 phases after the last
+			int iPhase = (2 * y + iFrame) % C_PIXEL_PHASE;
+
+			for (int x = 0; x < FRAME_WIDTH; ++x)
+			{
+				aryPKernel[x + C_NTSC_TAP / 2] = aryKernel[iPhase][aPixelLine[x] & (C_PIXEL_INDEX - 1)];
+				iPhase = (iPhase == C_PIXEL_PHASE - 1) ? 0 : iPhase + 1;
+			}
+
+			if (fAvx2)
+				NtscLineAvx2(aryPKernel, aRgbaLine);
+			else
+				NtscLine(aryPKernel, aRgbaLine);
+		}
+	}
+
+	// sum the taps for one line. aryPKernel is the line's padded kernels from NtscBand.
+	// output pixel x is tap 0 of pixel x + 2, through tap 4 of pixel x - 2
+
+	static void NtscLine(const float* const* aryPKernel, u32* aRgbaLine)
+	{
+		for (int x = 0; x < FRAME_WIDTH; ++x)
+		{
+			float aryAcc[8] = {};
+			for (int iTap = 0; iTap < C_NTSC_TAP; ++iTap)
+			{
+				const float* pKernel = aryPKernel[x + C_NTSC_TAP - 1 - iTap] + iTap * 8;
+				for (int i = 0; i < 8; ++i)
+				{
+					aryAcc[i] += pKernel[i];
+				}
+			}
+
+			aRgbaLine[2 * x] = RgbaFromRgb(aryAcc[0], aryAcc[1], aryAcc[2]);
+			aRgbaLine[2 * x + 1] = RgbaFromRgb(aryAcc[4], aryAcc[5], aryAcc[6]);
+		}
+	}
+
+	TARGET_AVX2 static void NtscLineAvx2(const float* const* aryPKernel, u32* aRgbaLine)
+	{
+		const __m256 scale = _mm256_set1_ps(255.0f);
+		const __m256 round = _mm256_set1_ps(0.5f);
+		const __m256 zero = _mm256_setzero_ps();
+		for (int x = 0; x < FRAME_WIDTH; ++x)
+		{
+			__m256 acc = _mm256_loadu_ps(aryPKernel[x + C_NTSC_TAP - 1]);
+			for (int iTap = 1; iTap < C_NTSC_TAP; ++iTap)
+			{
+				acc = _mm256_add_ps(acc, _mm256_loadu_ps(aryPKernel[x + C_NTSC_TAP - 1 - iTap] + iTap * 8));
+			}
+
+			acc = _mm256_add_ps(_mm256_mul_ps(acc, scale), round);
+			acc = _mm256_min_ps(_mm256_max_ps(acc, zero), scale);
+
+			// 8 ints to 8 bytes. each pack works within a 128 bit lane,
+			// leaving one output pixel in the bottom of each lane
+			__m256i rgba = _mm256_cvttps_epi32(acc);
+			rgba = _mm256_packus_epi32(rgba, rgba);
+			rgba = _mm256_packus_epi16(rgba, rgba);
+
+			aRgbaLine[2 * x] = _mm256_extract_epi32(rgba, 0) | 0xFF000000;
+			aRgbaLine[2 * x + 1] = _mm256_extract_epi32(rgba, 4) | 0xFF000000;
+		}
+	}
+};
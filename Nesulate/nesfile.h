@@ -1,41 +1,108 @@
 #pragma once
 #include <cstdio>
 #include "Types.h"
-#include <cassert>
+#include <atomic>
+
+// prg and chr rom of a cartridge.
+// loaded once and referenced (never copied) by every machine running it, on any thread
+
+struct Rom
+{
+	std::atomic<int> cRef;
+
+	half nMapper;
+
+	// name table mirroring, header byte 6 bit 0
+	bool fVerticalMirroring;
+
+	byte* pbPrg;
+	u32 cbPrg;
+
+	byte* pbChr;
+	u32 cbChr;	// 0 when the cartridge has chr ram instead
+
+	void AddRef()
+	{
+		cRef++;
+	}
+
+	void Release()
+	{
+		if (--cRef == 0)
+		{
+			delete[] pbPrg;
+			delete[] pbChr;
+			delete this;
+		}
+	}
+
+	byte ReadPrg(half addr) const
+	{
+		// mapper 0 (NROM), 16Kb roms are mirrored into $C000-$FFFF
+		return pbPrg[(addr - 0x8000) % cbPrg];
+	}
+
+	// which 16Kb prg bank addr is mapped to, as numbered in the file
+	int IBankPrg(half addr) const
+	{
+		return ((addr - 0x8000) % cbPrg) / (16 * KB);
+	}
+
+	byte ReadChr(half addr) const
+	{
+		return pbChr[addr % cbChr];
+	}
+};
 
 // https://wiki.nesdev.com/w/index.php/INES
 // https://wiki.nesdev.com/w/index.php/NES_2.0
-// load NES 2.0 files
+// load NES 2.0 files, and plain iNES ones without the 2.0 extensions
 
 class NesFile
 {
 public:
-	void Load(FILE* pFile)
+	// false if the file is not a rom we can run, or is cut short.
+	// the last rom loaded stays loaded
+	bool FLoad(FILE* pFile)
 	{
 		// read header
 
 		byte header[16];
-		fread(&header, sizeof(byte), 16, pFile);
+		if (fread(header, sizeof(byte), 16, pFile) != 16)
+			return false;
 
 		// validate file format
 		// begins with "NES" followed by MS-DOS end-of-file
-		assert(WordAt(header) == 0x4E45531A); 
+		if (header[0] != 'N' || header[1] != 'E' || header[2] != 'S' || header[3] != 0x1A)
+			return false;
 
-		// make sure we are a nes 2.0 rom
-		// if header byte 7 AND $0C = $08
-		// then assume we are nes 2.0
-		assert((header[7] & 0x0C) == 0x08);
+		// if header byte 7 AND $0C = $08 we are nes 2.0, and bytes 8-15 mean something.
+		// in an older iNES file they are often garbage, so leave them alone
+		bool fNes2 = (header[7] & 0x0C) == 0x08;
 
-		// program rom size
-		// header 4 and lower 4 bits from header 9
+		// program rom size in 16Kb units
+		// header 4, and for nes 2.0 the lower 4 bits of header 9 on top
 		half nPrgRom = header[4];
-		nPrgRom |= (header[9] & 0xF0) << 8;
 
-		// character rom size
-		// header 4 and upper 4 bits from header 9
+		// character rom size in 8Kb units
+		// header 5, and for nes 2.0 the upper 4 bits of header 9 on top
 		// (0 indicates CHR RAM)
 		half nChrRom = header[5];
-		nChrRom |= (header[9] & 0x0F) << 4;
+
+		if (fNes2)
+		{
+			// an msb nibble of $F is the exponent-multiplier notation, only used for
+			// sizes that are not a multiple of the unit, which NROM never is
+			if ((header[9] & 0x0F) == 0x0F || (header[9] & 0xF0) == 0xF0)
+				return false;
+
+			nPrgRom |= (header[9] & 0x0F) << 8;
+			nChrRom |= (header[9] & 0xF0) << 4;
+		}
+
+		// every mapper has some prg rom, and Rom::ReadPrg divides by its size
+		if (nPrgRom == 0)
+			return false;
 
 		// mapper number (12 bits)
 		// top 4 bits of byte 6 are lower 4 bits of mapper number
@@ -44,14 +111,58 @@ public:
 		// top 4 bits of byte 7 are next 4 bits of mapper number
 		nMapper |= (header[7] & 0xF0);
 
-		// lower 4 bits of byte 8 are highest 4 bits of mapper number
-		nMapper |= (header[8] & 0x0F) << 8;
+		// lower 4 bits of byte 8 are highest 4 bits of mapper number.
+		// the upper 4 bits are the sub mapper, which NROM does not have
+		if (fNes2)
+			nMapper |= (header[8] & 0x0F) << 8;
+
+		// 512 byte trainer, skip it
+		if (header[6] & 0x04)
+		{
+			if (fseek(pFile, 512, SEEK_CUR) != 0)
+				return false;
+		}
+
+		// prg rom in 16Kb units, then chr rom in 8Kb units
+
+		Rom* pRomNew = new Rom;
+		pRomNew->cRef = 1;
+		pRomNew->nMapper = nMapper;
+		pRomNew->fVerticalMirroring = (header[6] & 0x01) != 0;
+
+		pRomNew->cbPrg = nPrgRom * 16 * KB;
+		pRomNew->pbPrg = new byte[pRomNew->cbPrg];
 
-		// sub mapper number
-		// upper 4 bits of byte 8
-		byte nSubMapper = (header[8] & 0xF0) >> 4;
+		pRomNew->cbChr = nChrRom * 8 * KB;
+		pRomNew->pbChr = pRomNew->cbChr ? new byte[pRomNew->cbChr] : nullptr;
 
+		if (fread(pRomNew->pbPrg, sizeof(byte), pRomNew->cbPrg, pFile) != pRomNew->cbPrg ||
+			fread(pRomNew->pbChr, sizeof(byte), pRomNew->cbChr, pFile) != pRomNew->cbChr)
+		{
+			pRomNew->Release();
+			return false;
+		}
+
+		if (pRom)
+			pRom->Release();
+		pRom = pRomNew;
+		return true;
 	}
+
+	~NesFile()
+	{
+		if (pRom)
+			pRom->Release();
+	}
+
+	// rom of the last file loaded. AddRef it to keep it past the NesFile
+	Rom* PRom() const
+	{
+		return pRom;
+	}
+
 private:
 	word flags;		// flags 6, 7, 9, 10
+
+	Rom* pRom = nullptr;
 };